@@ -12,21 +12,49 @@
  * GNU General Public License for more details.
  */
 
+#include "gvaluer.h"
+
 #include <string>
+#include <stdexcept>
 #include <cstdlib>
 #include <cstdio>
 #include <cstdarg>
+#include <cstring>
 #include <climits>
+#include <ctime>
+#include <cstdint>
+#include <cerrno>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
 #include <cctype>
 #include <vector>
 #include <algorithm>
 #include <set>
 #include <unordered_map>
+#include <random>
+#include <thread>
+#include <atomic>
 
 #define CONTINUE_READING 1
 #define GROUP_READY 0
 #define BUF_SIZE 1024
+// the longest line of a comment, not counting the group id in it;
+// tests/alloc_test.cpp fails if a message outgrows it
+#define COMMENT_LINE_SIZE 256
+
+// the count of tests the judge sends to ask for the binary protocol
+#define BINARY_PROTOCOL_COUNT (-2)
+#define BINARY_PROTOCOL_MAGIC "GVB1"
+
+// a compiled config is stored next to the config with this suffix
+#define CONFIG_CACHE_SUFFIX ".cache"
+// to be raised whenever the cached group layout changes
+#define CONFIG_CACHE_VERSION 2
 
 enum
 {
@@ -53,7 +81,35 @@ enum
     RUN_SUMMONED         = 23,
 };
 
-static std::unordered_map<std::string, int> string_to_status = { 
+// why a group did not get the tests (or the score) it could have got
+enum
+{
+    SKIP_NONE      = 0,
+    SKIP_REQUIRES  = 1,    // one of the required groups has not passed
+    SKIP_TEST_STOP = 2,    // a test has failed, the rest of the group is not run
+    SKIP_ZERO_SET  = 3,    // the group is scored 0 by a 0_if rule
+    SKIP_CONFIG    = 4,    // skip or skip_if_not_rejudge
+    SKIP_DECIDED   = 5,    // the outcome of a stop_if_decided group is known
+    SKIP_TARGET    = 6,    // the score is known to be above or not above the target
+    SKIP_REASON_COUNT
+};
+
+enum
+{
+    GROUP_PASSED  = 0,
+    GROUP_FAILED  = 1,
+    GROUP_SKIPPED = 2,
+};
+
+// flags of a group record in the structured report
+enum
+{
+    REPORT_OFFLINE     = 1,
+    REPORT_SETS_MARKED = 2,    // the group has the sets_marked flag
+    REPORT_MARKED      = 4,    // the group has marked the run
+};
+
+static const std::unordered_map<std::string, int> string_to_status = { 
     { "AC", RUN_ACCEPTED } 
     , { "CE", RUN_COMPILE_ERR }
 		, { "CF", RUN_CHECK_FAILED }
@@ -77,11 +133,17 @@ static std::unordered_map<std::string, int> string_to_status = {
 		, { "WT", RUN_WALL_TIME_LIMIT_ERR }
     };
 
+class ValuerError : public std::runtime_error
+{
+public:
+    explicit ValuerError(const std::string &msg) : std::runtime_error(msg) {}
+};
+
 static void
-die(const char *, ...)
+fail(const char *, ...)
     __attribute__((noreturn, format(printf, 1, 2)));
 static void
-die(const char *format, ...)
+fail(const char *format, ...)
 {
     va_list args;
     char buf[BUF_SIZE];
@@ -90,15 +152,97 @@ die(const char *format, ...)
     vsnprintf(buf, sizeof(buf), format, args);
     va_end(args);
 
-    fprintf(stderr, "fatal: %s\n", buf);
-    exit(RUN_CHECK_FAILED);
+    throw ValuerError(buf);
+}
+
+static uint64_t fnv1a64(const void *data, size_t size, uint64_t hash = 14695981039346656037ULL)
+{
+    const unsigned char *p = (const unsigned char *) data;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void
+append_printf(std::string &out, const char *, ...)
+    __attribute__((format(printf, 2, 3)));
+static void
+append_printf(std::string &out, const char *format, ...)
+{
+    va_list args;
+    char buf[BUF_SIZE];
+
+    va_start(args, format);
+    vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+
+    out += buf;
+}
+
+static void store_int32(unsigned char *p, int32_t value)
+{
+    uint32_t u = uint32_t(value);
+    p[0] = u & 0xff;
+    p[1] = (u >> 8) & 0xff;
+    p[2] = (u >> 16) & 0xff;
+    p[3] = (u >> 24) & 0xff;
+}
+
+static int32_t load_int32(const unsigned char *p)
+{
+    return int32_t(p[0] | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24));
+}
+
+static void put_int32(std::string &buf, int32_t value)
+{
+    unsigned char p[4];
+    store_int32(p, value);
+    buf.append((const char *) p, 4);
 }
 
-static bool marked_flag;
-static bool user_score_flag;
-static bool interactive_flag;
-static bool rejudge_flag;
-static int locale_id = 0;
+static void put_string(std::string &buf, const std::string &str)
+{
+    put_int32(buf, str.length());
+    buf += str;
+}
+
+// reads what put_int32 and put_string have written
+class CacheReader
+{
+    const unsigned char *p;
+    const unsigned char *end;
+
+public:
+    CacheReader(const char *buf, size_t size)
+        : p((const unsigned char *) buf), end((const unsigned char *) buf + size) {}
+
+    bool at_end() const { return p == end; }
+
+    int get_uint8()
+    {
+        if (p == end) fail("truncated cache");
+        return *p++;
+    }
+
+    int32_t get_int32()
+    {
+        if (end - p < 4) fail("truncated cache");
+        int32_t value = load_int32(p);
+        p += 4;
+        return value;
+    }
+
+    std::string get_string()
+    {
+        int32_t len = get_int32();
+        if (len < 0 || end - p < len) fail("truncated cache");
+        std::string str((const char *) p, len);
+        p += len;
+        return str;
+    }
+};
 
 static int parse_status(const std::string &str)
 {
@@ -108,9 +252,11 @@ static int parse_status(const std::string &str)
     status_string[0] = toupper(status_string[0]);
     status_string[1] = toupper(status_string[1]);
 
-    if (string_to_status.find(status_string) == string_to_status.end()) return -1;
+    // find only: parses may go on in several threads at once
+    auto it = string_to_status.find(status_string);
+    if (it == string_to_status.end()) return -1;
 
-    return string_to_status[status_string];
+    return it->second;
 }
 
 class ConfigParser;
@@ -128,17 +274,23 @@ class Group
     bool stat_to_judges = false;
     bool stat_to_users = false;
     bool test_all = false;
+    bool stop_if_decided = false;
     int score = 0;
     int test_score = -1;
     int pass_if_count = -1;
     int user_status = -1;
 
     int passed_count = 0;
+    int tested_count = 0;
     int total_score = 0;
-    std::string comment;
+    int skip_reason = SKIP_NONE;
+    int skip_param = 0;
 
     std::vector<std::set<int> > zero_sets;
-    std::set<int> passed_set;
+    // bit t - first is test t; passed_bits keeps its size between runs,
+    // so that a run does not allocate
+    std::vector<uint64_t> passed_bits;
+    std::vector<std::vector<uint64_t> > zero_bits;
 
 public:
     Group() {}
@@ -157,6 +309,7 @@ public:
 
     void add_requires(const std::string &s) { requires.push_back(s); }
     const std::vector<std::string> &get_requires() const { return requires; }
+    std::vector<std::string> &get_requires() { return requires; }
 
     void add_sets_marked_if_passed(const std::string &s) { sets_marked_if_passed.push_back(s); }
     const std::vector<std::string> &get_sets_marked_if_passed() const { return sets_marked_if_passed; }
@@ -188,6 +341,16 @@ public:
     void set_test_all(bool value) { test_all = value; }
     bool get_test_all() const { return test_all; }
 
+    void set_stop_if_decided(bool value) { stop_if_decided = value; }
+    bool get_stop_if_decided() const { return stop_if_decided; }
+
+    // true when the remaining tests can't change is_passed()
+    bool is_decided(int next_test) const
+    {
+        if (passed_count >= pass_if_count) return true;
+        return passed_count + (last - next_test + 1) < pass_if_count;
+    }
+
     void inc_passed_count() { ++passed_count; }
     int get_passed_count() const { return passed_count; }
     bool is_passed() const
@@ -196,24 +359,54 @@ public:
         return passed_count == (last - first + 1);
     }
 
+    void inc_tested_count() { ++tested_count; }
+    int get_tested_count() const { return tested_count; }
+
+    int get_status() const
+    {
+        if (is_passed()) return GROUP_PASSED;
+        if (tested_count == 0) return GROUP_SKIPPED;
+        return GROUP_FAILED;
+    }
+
+    // param is the failed test for SKIP_TEST_STOP and the index
+    // of the failed required group for SKIP_REQUIRES
+    void set_skip_reason(int reason, int param = 0)
+    {
+        skip_reason = reason;
+        skip_param = param;
+    }
+    int get_skip_reason() const { return skip_reason; }
+    int get_skip_param() const { return skip_param; }
+
+    int get_bitmap_words() const { return (last - first + 64) / 64; }
+
     void add_passed_test(int test_num)
     {
-        passed_set.insert(test_num);
+        int bit = test_num - first;
+        passed_bits[bit / 64] |= uint64_t(1) << (bit % 64);
+    }
+    const std::vector<uint64_t> &get_passed_bits() const { return passed_bits; }
+
+    // puts back the state saved in a checkpoint, without the passed tests
+    void restore_state(int passed_count, int tested_count, int total_score, int reason, int param)
+    {
+        this->passed_count = passed_count;
+        this->tested_count = tested_count;
+        this->total_score = total_score;
+        skip_reason = reason;
+        skip_param = param;
     }
 
     bool is_zero_set() const
     {
-        for (int i = 0; i < int(zero_sets.size()); ++i) {
-            if (passed_set == zero_sets[i])
+        for (const std::vector<uint64_t> &zb : zero_bits) {
+            if (passed_bits == zb)
                 return true;
         }
         return false;
     }
 
-    void set_comment(const std::string &comment_) { comment = comment_; }
-    const std::string &get_comment() const { return comment; }
-    bool has_comment() const { return comment.length() > 0; }
-
     void set_test_score(int ts) { test_score = ts; }
     int get_test_score() const { return test_score; }
 
@@ -224,9 +417,60 @@ public:
     {
         zero_sets.emplace_back(zs);
     }
+    const std::vector<std::set<int> > &get_zero_sets() const { return zero_sets; }
 
     bool meet_requirements(const ConfigParser &cfg, const Group *& grp) const;
 
+    // the config part of the group, for compiled config caches
+    void save_config(std::string &buf) const
+    {
+        put_string(buf, group_id);
+        put_int32(buf, first);
+        put_int32(buf, last);
+        put_int32(buf, requires.size());
+        for (const std::string &r : requires) put_string(buf, r);
+        put_int32(buf, sets_marked_if_passed.size());
+        for (const std::string &r : sets_marked_if_passed) put_string(buf, r);
+        put_int32(buf, is_offline | sets_marked << 1 | skip << 2 | skip_if_not_rejudge << 3
+                  | stat_to_judges << 4 | stat_to_users << 5 | test_all << 6 | stop_if_decided << 7);
+        put_int32(buf, score);
+        put_int32(buf, test_score);
+        put_int32(buf, pass_if_count);
+        put_int32(buf, user_status);
+        put_int32(buf, zero_sets.size());
+        for (const std::set<int> &zs : zero_sets) {
+            put_int32(buf, zs.size());
+            for (int t : zs) put_int32(buf, t);
+        }
+    }
+
+    void load_config(CacheReader &in)
+    {
+        group_id = in.get_string();
+        first = in.get_int32();
+        last = in.get_int32();
+        for (int n = in.get_int32(); n > 0; --n) requires.push_back(in.get_string());
+        for (int n = in.get_int32(); n > 0; --n) sets_marked_if_passed.push_back(in.get_string());
+        int flags = in.get_int32();
+        is_offline = flags & 1;
+        sets_marked = flags & 2;
+        skip = flags & 4;
+        skip_if_not_rejudge = flags & 8;
+        stat_to_judges = flags & 16;
+        stat_to_users = flags & 32;
+        test_all = flags & 64;
+        stop_if_decided = flags & 128;
+        score = in.get_int32();
+        test_score = in.get_int32();
+        pass_if_count = in.get_int32();
+        user_status = in.get_int32();
+        for (int n = in.get_int32(); n > 0; --n) {
+            std::set<int> zs;
+            for (int k = in.get_int32(); k > 0; --k) zs.insert(in.get_int32());
+            zero_sets.emplace_back(std::move(zs));
+        }
+    }
+
     void add_total_score()
     {
         if (test_score > 0) total_score += test_score;
@@ -237,10 +481,47 @@ public:
     }
     int get_total_score() const { return total_score; }
 
+    // forgets the results of the previous run
+    void reset_state()
+    {
+        passed_count = 0;
+        tested_count = 0;
+        total_score = 0;
+        skip_reason = SKIP_NONE;
+        skip_param = 0;
+        passed_bits.assign(get_bitmap_words(), 0);
+    }
+
+    // makes the zero sets bitmaps and sizes the run state, once the config is final
+    void prepare_state()
+    {
+        zero_bits.clear();
+        for (const std::set<int> &zs : zero_sets) {
+            std::vector<uint64_t> bits(get_bitmap_words());
+            bool fits = true;
+            for (int t : zs) {
+                // a set with a test of another group is never met
+                if (t < first || t > last) fits = false;
+                else bits[(t - first) / 64] |= uint64_t(1) << ((t - first) % 64);
+            }
+            if (fits) zero_bits.push_back(std::move(bits));
+        }
+        reset_state();
+    }
+
+    // the most calc_score can give
+    int max_score() const
+    {
+        if (test_score >= 0) return test_score * (last - first + 1);
+        return std::max(score, 0);
+    }
+
     int calc_score() const
     {
         if (test_score < 0 && passed_count == (last - first + 1)) {
             return score;
+        } else if (test_score < 0 && stop_if_decided && is_passed()) {
+            return score;
         } else if (test_score >= 0) {
             return total_score;
         }
@@ -248,6 +529,103 @@ public:
     }
 };
 
+class GroupGenerator
+{
+    std::string prefix;
+    int count = 0;
+    Group shape;                // the range covers all the generated groups
+    std::vector<int> scores;
+    bool requires_prev = false;
+
+public:
+    // stands for prev among the requires of the shape, keeping its place
+    static const char *prev_placeholder() { return ""; }
+
+    void set_prefix(const std::string &prefix_) { prefix = prefix_; }
+    const std::string &get_prefix() const { return prefix; }
+
+    void set_count(int count) { this->count = count; }
+    int get_count() const { return count; }
+
+    Group &get_shape() { return shape; }
+    const Group &get_shape() const { return shape; }
+
+    void add_score(int score) { scores.push_back(score); }
+    const std::vector<int> &get_scores() const { return scores; }
+
+    void set_requires_prev(bool value) { requires_prev = value; }
+    bool get_requires_prev() const { return requires_prev; }
+
+    int get_first() const { return shape.get_first(); }
+    int get_last() const { return shape.get_last(); }
+    int get_size() const { return (shape.get_last() - shape.get_first() + 1) / count; }
+
+    std::string make_id(int index) const { return prefix + std::to_string(index + 1); }
+
+    // true when id is the prefix followed by a number
+    static bool matches_prefix(const std::string &id, const std::string &prefix)
+    {
+        if (id.length() <= prefix.length() || id.compare(0, prefix.length(), prefix) != 0) return false;
+        for (size_t i = prefix.length(); i < id.length(); ++i) {
+            if (!isdigit((unsigned char) id[i])) return false;
+        }
+        return true;
+    }
+    bool matches_prefix(const std::string &id) const { return matches_prefix(id, prefix); }
+
+    // the index of the generated group with the given id, or -1
+    int find_index(const std::string &id) const
+    {
+        if (!matches_prefix(id) || id[prefix.length()] == '0') return -1;
+        if (id.length() - prefix.length() > 9) return -1;
+        int index = std::stoi(id.substr(prefix.length())) - 1;
+        if (index >= count) return -1;
+        return index;
+    }
+
+    void save_config(std::string &buf) const
+    {
+        put_string(buf, prefix);
+        put_int32(buf, count);
+        shape.save_config(buf);
+        put_int32(buf, scores.size());
+        for (int sc : scores) put_int32(buf, sc);
+        put_int32(buf, requires_prev);
+    }
+
+    void load_config(CacheReader &in)
+    {
+        prefix = in.get_string();
+        count = in.get_int32();
+        shape.load_config(in);
+        for (int n = in.get_int32(); n > 0; --n) scores.push_back(in.get_int32());
+        requires_prev = in.get_int32();
+        if (count <= 0) fail("invalid cache");
+    }
+
+    Group make_group(int index) const
+    {
+        Group g = shape;
+        int size = get_size();
+        g.set_group_id(make_id(index));
+        g.set_range(shape.get_first() + index * size, shape.get_first() + (index + 1) * size - 1);
+        if (!scores.empty()) g.set_score(scores[index % scores.size()]);
+        if (requires_prev) {
+            std::vector<std::string> &requires = g.get_requires();
+            for (auto i = requires.begin(); i != requires.end();) {
+                if (*i != prev_placeholder()) {
+                    ++i;
+                } else if (index > 0) {
+                    *i++ = make_id(index - 1);
+                } else {
+                    i = requires.erase(i);
+                }
+            }
+        }
+        return g;
+    }
+};
+
 class Global
 {
     int stat_to_judges = -1;
@@ -279,6 +657,21 @@ public:
     int get_stat_to_users() const { return stat_to_users; }
 };
 
+/*
+ * What the run does at a group as far as it depends on the config only:
+ * the required groups and the sets_marked_if_passed groups as indices
+ * (-1 for an unknown group), the first test from the group on that is
+ * not skipped by the config, without and with rejudge, and the most the
+ * groups from this one on can score.
+ */
+struct GroupDecision
+{
+    std::vector<int> requires;
+    std::vector<int> marks_if_passed;
+    int run_from[2];
+    int max_score_from;
+};
+
 class ConfigParser
 {
 public:
@@ -286,8 +679,11 @@ public:
     const int T_IDENT = 257;
 
 private:
-    FILE *in_f = NULL;
+    const char *in_buf = NULL;
+    size_t in_size = 0;
+    size_t in_ofs = 0;
     std::string path;
+    uint64_t config_hash = 0;
     int line;
     int pos;
 
@@ -302,6 +698,17 @@ private:
 
     Global global;
     std::vector<Group> groups;
+    std::vector<GroupGenerator> generators;
+
+    // built by build_decisions: the group index of every test, from test table_first on
+    std::vector<int> test_groups;
+    int table_first = 0;
+    std::vector<GroupDecision> decisions;
+    // whether write_hints expects a group to pass, for the groups not over yet
+    std::vector<char> hint_passes;
+    // the longest comments a run can make
+    size_t comment_bound = 0;
+    size_t judge_comment_bound = 0;
 
 private:
     void find_next_char()
@@ -361,17 +768,11 @@ public:
     {
     }
 
-    ~ConfigParser()
-    {
-        if (!in_f) fclose(in_f);
-        in_f = NULL;
-    }
-
     void next_char()
     {
         c_line = line;
         c_pos = pos;
-        in_c = fgetc(in_f);
+        in_c = in_ofs < in_size ? (unsigned char) in_buf[in_ofs++] : EOF;
         if (in_c == '\n') {
             pos = 0;
             ++line;
@@ -391,8 +792,8 @@ public:
         scan_error("invalid character");
     }
 
-    void scan_error(const std::string &msg) const;
-    void parse_error(const std::string &msg) const;
+    void scan_error(const std::string &msg) const __attribute__((noreturn));
+    void parse_error(const std::string &msg) const __attribute__((noreturn));
 
     int read_int_opt(int default_value)
     {
@@ -408,19 +809,22 @@ public:
         return value;
     }
 
-    void parse_group()
+    void add_requires(Group &parsed_group, GroupGenerator *gen)
+    {
+        if (gen && token == "prev") {
+            gen->set_requires_prev(true);
+            parsed_group.add_requires(GroupGenerator::prev_placeholder());
+        } else {
+            parsed_group.add_requires(token);
+        }
+    }
+
+    // the statements inside the braces of a group or a generator
+    void parse_group_body(Group &parsed_group, GroupGenerator *gen)
     {
-        Group parsed_group;
         bool has_stat_to_judges = false;
         bool has_stat_to_users = false;
 
-        if (token != "group") parse_error("'group' expected");
-        next_token();
-        if (t_type != T_IDENT) parse_error("IDENT expected");
-        if (find_group(token) != NULL)
-            parse_error(std::string("group ") + token + " already defined");
-        parsed_group.set_group_id(token);
-        next_token();
         if (t_type != '{') parse_error("'{' expected");
         next_token();
         while (1) {
@@ -453,12 +857,12 @@ public:
             } else if (token == "requires") {
                 next_token();
                 if (t_type != T_IDENT) parse_error("IDENT expected");
-                parsed_group.add_requires(token);
+                add_requires(parsed_group, gen);
                 next_token();
                 while (t_type == ',') {
                     next_token();
                     if (t_type != T_IDENT) parse_error("IDENT expected");
-                    parsed_group.add_requires(token);
+                    add_requires(parsed_group, gen);
                     next_token();
                 }
                 if (t_type != ';') parse_error("';' expected");
@@ -477,6 +881,7 @@ public:
                 if (t_type != ';') parse_error("';' expected");
                 next_token();
             } else if (token == "0_if") {
+                if (gen) parse_error("0_if is not allowed in generate");
                 std::set<int> zs;
                 try {
                     next_token();
@@ -540,6 +945,11 @@ public:
                 if (t_type != ';') parse_error("';' expected");
                 next_token();
                 parsed_group.set_test_all(true);
+            } else if (token == "stop_if_decided") {
+                next_token();
+                if (t_type != ';') parse_error("';' expected");
+                next_token();
+                parsed_group.set_stop_if_decided(true);
             } else if (token == "score") {
                 next_token();
                 if (t_type != T_IDENT) parse_error("NUM expected");
@@ -551,9 +961,25 @@ public:
                 }
                 if (score < 0) parse_error("invalid score");
                 next_token();
+                parsed_group.set_score(score);
+                if (gen) {
+                    // a generator cycles through a list of scores
+                    gen->add_score(score);
+                    while (t_type == ',') {
+                        next_token();
+                        score = -1;
+                        try {
+                            score = stoi(token);
+                        } catch (...) {
+                            parse_error("NUM expected");
+                        }
+                        if (score < 0) parse_error("invalid score");
+                        gen->add_score(score);
+                        next_token();
+                    }
+                }
                 if (t_type != ';') parse_error("';' expected");
                 next_token();
-                parsed_group.set_score(score);
             } else if (token == "test_score") {
                 next_token();
                 if (t_type != T_IDENT) parse_error("NUM expected");
@@ -596,6 +1022,10 @@ public:
             }
         }
         if (t_type != '}') parse_error("'}' expected");
+        if (parsed_group.get_stop_if_decided()) {
+            if (parsed_group.get_pass_if_count() <= 0) parse_error("stop_if_decided requires pass_if_count");
+            if (parsed_group.get_test_score() >= 0) parse_error("stop_if_decided conflicts with test_score");
+        }
         next_token();
         if (!has_stat_to_judges && global.get_stat_to_judges() >= 0) {
             parsed_group.set_stat_to_judges(bool(global.get_stat_to_judges()));
@@ -603,59 +1033,212 @@ public:
         if (!has_stat_to_users && global.get_stat_to_users() >= 0) {
             parsed_group.set_stat_to_users(bool(global.get_stat_to_users()));
         }
+    }
+
+    void parse_group()
+    {
+        Group parsed_group;
+
+        if (token != "group") parse_error("'group' expected");
+        next_token();
+        if (t_type != T_IDENT) parse_error("IDENT expected");
+        if (find_group_first(token) >= 0)
+            parse_error(std::string("group ") + token + " already defined");
+        for (const GroupGenerator &gen : generators) {
+            if (gen.matches_prefix(token))
+                parse_error(std::string("group ") + token + " clashes with generator " + gen.get_prefix());
+        }
+        parsed_group.set_group_id(token);
+        next_token();
+        parse_group_body(parsed_group, NULL);
         groups.push_back(parsed_group);
     }
 
+    /*
+     * generate PREFIX COUNT { tests FIRST-LAST; ... }
+     * declares COUNT groups PREFIX1, PREFIX2, ... of the same size that
+     * split the tests FIRST-LAST. The body is that of a group, except that
+     * score may list several scores to cycle through and requires may
+     * name 'prev', the previous generated group.
+     */
+    void parse_generator()
+    {
+        GroupGenerator gen;
+        Group &shape = gen.get_shape();
+
+        next_token();
+        if (t_type != T_IDENT) parse_error("IDENT expected");
+        for (const Group &g : groups) {
+            if (gen.matches_prefix(g.get_group_id(), token))
+                parse_error(std::string("generator ") + token + " clashes with group " + g.get_group_id());
+        }
+        for (const GroupGenerator &other : generators) {
+            if (other.matches_prefix(token) || gen.matches_prefix(other.get_prefix(), token))
+                parse_error(std::string("generator ") + token + " clashes with generator " + other.get_prefix());
+        }
+        gen.set_prefix(token);
+        next_token();
+        int count = -1;
+        try {
+            count = stoi(token);
+        } catch (...) {
+            parse_error("NUM expected");
+        }
+        if (count <= 0) parse_error("invalid group count");
+        gen.set_count(count);
+        next_token();
+        parse_group_body(shape, &gen);
+
+        if (shape.get_first() <= 0) parse_error("tests expected");
+        if ((shape.get_last() - shape.get_first() + 1) % count != 0)
+            parse_error("tests can't be split into groups of the same size");
+        generators.push_back(gen);
+    }
+
+    // the range of tests of a group or a generator, for validation
+    struct Span
+    {
+        int first;
+        int last;
+        bool offline;
+        std::string first_id;
+        std::string last_id;
+    };
+
     void parse_groups()
     {
-        while (token == "group") {
-            parse_group();
+        while (token == "group" || token == "generate") {
+            if (token == "group") {
+                parse_group();
+            } else {
+                parse_generator();
+            }
         }
-        if (groups.size() <= 0) parse_error("no groups defined");
+        if (groups.size() + generators.size() <= 0) parse_error("no groups defined");
         sort(groups.begin(), groups.end(), [](const Group &g1, const Group &g2) -> bool { return g1.get_first() < g2.get_first(); });
-        for (int i = 1; i < int(groups.size()); ++i) {
-            if (groups[i].get_first() <= groups[i - 1].get_last()) {
-                parse_error(std::string("groups ") + groups[i - 1].get_group_id() + " and " + groups[i].get_group_id() + " overlap");
+
+        std::vector<Span> spans;
+        for (const Group &g : groups) {
+            spans.push_back({ g.get_first(), g.get_last(), g.get_offline(), g.get_group_id(), g.get_group_id() });
+        }
+        for (const GroupGenerator &gen : generators) {
+            spans.push_back({ gen.get_first(), gen.get_last(), gen.get_shape().get_offline(),
+                              gen.make_id(0), gen.make_id(gen.get_count() - 1) });
+        }
+        sort(spans.begin(), spans.end(), [](const Span &s1, const Span &s2) -> bool { return s1.first < s2.first; });
+        for (int i = 1; i < int(spans.size()); ++i) {
+            if (spans[i].first <= spans[i - 1].last) {
+                parse_error(std::string("groups ") + spans[i - 1].last_id + " and " + spans[i].first_id + " overlap");
             }
-            if (groups[i].get_first() != groups[i - 1].get_last() + 1) {
-                parse_error(std::string("hole between groups ") + groups[i - 1].get_group_id() + " and " + groups[i].get_group_id());
+            if (spans[i].first != spans[i - 1].last + 1) {
+                parse_error(std::string("hole between groups ") + spans[i - 1].last_id + " and " + spans[i].first_id);
             }
         }
-        for (int i = 0; i < int(groups.size()); ++i) {
-            const std::vector<std::string> &r = groups[i].get_requires();
-            for (int j = 0; j < int(r.size()); ++j) {
-                int k;
-                for (k = 0; k < i; ++k) {
-                    if (groups[k].get_group_id() == r[j])
-                        break;
-                }
-                if (k >= i) {
-                    parse_error(std::string("no group ") + r[j] + " before group " + groups[i].get_group_id());
+
+        for (const Group &g : groups) {
+            check_group_refs(g, g.get_first(), g.get_group_id());
+        }
+        for (const GroupGenerator &gen : generators) {
+            check_group_refs(gen.get_shape(), gen.get_first(), gen.make_id(0));
+        }
+
+        int i;
+        for (i = 0; i < int(spans.size()); ++i) {
+            if (spans[i].offline)
+                break;
+        }
+        if (i < int(spans.size())) {
+            for (; i < int(spans.size()); ++i) {
+                if (!spans[i].offline) {
+                    parse_error("all offline groups must follow all online groups");
                 }
             }
         }
-        for (int i = 0; i < int(groups.size()); ++i) {
-            const std::vector<std::string> &r = groups[i].get_sets_marked_if_passed();
-            for (int j = 0; j < int(r.size()); ++j) {
-                int k;
-                for (k = 0; k <= i; ++k) {
-                    if (groups[k].get_group_id() == r[j])
-                        break;
-                }
-                if (k > i) {
-                    parse_error(std::string("no group ") + r[j] + " before group " + groups[i].get_group_id());
+    }
+
+    // requires must name groups before the group, sets_marked_if_passed
+    // groups before or the group itself
+    void check_group_refs(const Group &g, int first, const std::string &id) const
+    {
+        for (const std::string &r : g.get_requires()) {
+            if (r == GroupGenerator::prev_placeholder()) continue;
+            int f = find_group_first(r);
+            if (f < 0 || f >= first) {
+                parse_error(std::string("no group ") + r + " before group " + id);
+            }
+        }
+        for (const std::string &r : g.get_sets_marked_if_passed()) {
+            int f = find_group_first(r);
+            if (f < 0 || f > first) {
+                parse_error(std::string("no group ") + r + " before group " + id);
+            }
+        }
+    }
+
+    // replaces the generators with the groups they declare
+    void expand_groups()
+    {
+        if (!generators.empty()) {
+            for (const GroupGenerator &gen : generators) {
+                for (int i = 0; i < gen.get_count(); ++i) {
+                    groups.push_back(gen.make_group(i));
                 }
             }
+            generators.clear();
+            sort(groups.begin(), groups.end(), [](const Group &g1, const Group &g2) -> bool { return g1.get_first() < g2.get_first(); });
+        } else if (!test_groups.empty()) {
+            return;
         }
-        int i;
-        for (i = 0; i < int(groups.size()); ++i) {
-            if (groups[i].get_offline())
-                break;
+        build_decisions();
+    }
+
+    // see GroupDecision, the groups must be expanded
+    void build_decisions()
+    {
+        int count = groups.size();
+        test_groups.clear();
+        decisions.assign(count, GroupDecision());
+        hint_passes.assign(count, 0);
+        if (count <= 0) return;
+
+        std::unordered_map<std::string, int> index;
+        for (int i = 0; i < count; ++i) index[groups[i].get_group_id()] = i;
+        table_first = groups[0].get_first();
+        test_groups.reserve(groups[count - 1].get_last() - table_first + 1);
+        for (int i = 0; i < count; ++i) {
+            Group &g = groups[i];
+            if (g.get_first() != table_first + int(test_groups.size())) fail("hole before group %s", g.get_group_id().c_str());
+            test_groups.insert(test_groups.end(), g.get_last() - g.get_first() + 1, i);
+            groups[i].prepare_state();
+            for (const std::string &r : g.get_requires()) {
+                auto it = index.find(r);
+                if (it == index.end()) fail("group %s not found", r.c_str());
+                decisions[i].requires.push_back(it->second);
+            }
+            for (const std::string &r : g.get_sets_marked_if_passed()) {
+                auto it = index.find(r);
+                decisions[i].marks_if_passed.push_back(it != index.end() ? it->second : -1);
+            }
         }
-        if (i < int(groups.size())) {
-            for (; i < int(groups.size()); ++i) {
-                if (!groups[i].get_offline()) {
-                    parse_error("all offline groups must follow all online groups");
+
+        size_t id_size = 0;
+        for (const Group &g : groups) id_size = std::max(id_size, g.get_group_id().size());
+        size_t line_size = std::min(size_t(COMMENT_LINE_SIZE) + id_size, size_t(BUF_SIZE));
+        comment_bound = judge_comment_bound = 0;
+        for (const Group &g : groups) {
+            comment_bound += line_size;
+            if (g.get_stat_to_users()) comment_bound += line_size;
+            if (g.get_stat_to_judges()) judge_comment_bound += line_size;
+        }
+
+        for (int i = count - 1; i >= 0; --i) {
+            const Group &g = groups[i];
+            decisions[i].max_score_from = g.max_score() + (i + 1 < count ? decisions[i + 1].max_score_from : 0);
+            for (int rejudge = 0; rejudge < 2; ++rejudge) {
+                if (g.get_skip() || (g.get_skip_if_not_rejudge() && !rejudge)) {
+                    decisions[i].run_from[rejudge] = i + 1 < count ? decisions[i + 1].run_from[rejudge] : g.get_last() + 1;
+                } else {
+                    decisions[i].run_from[rejudge] = g.get_first();
                 }
             }
         }
@@ -690,13 +1273,17 @@ public:
         next_token();
     }
 
-    void parse(const std::string &configpath)
+    void parse(const char *buf, size_t size, const std::string &configpath)
     {
         path = configpath;
         line = 1;
         pos = 0;
-        in_f = fopen(configpath.c_str(), "r");
-        if (!in_f) die("cannot open config file '%s'", configpath.c_str());
+        in_buf = buf;
+        in_size = size;
+        in_ofs = 0;
+        config_hash = fnv1a64(buf, size);
+        test_groups.clear();
+        decisions.clear();
         next_char();
         next_token();
         parse_opt_global();
@@ -704,8 +1291,23 @@ public:
         if (token != "") {
             parse_error("EOF expected");
         }
+        in_buf = NULL;
+    }
+
+    // the first test of the group with the given id, or -1
+    int find_group_first(const std::string &id) const
+    {
+        const Group *g = find_group(id);
+        if (g) return g->get_first();
+        for (const GroupGenerator &gen : generators) {
+            int index = gen.find_index(id);
+            if (index >= 0) return gen.get_first() + index * gen.get_size();
+        }
+        return -1;
     }
 
+    const std::vector<GroupGenerator> &get_generators() const { return generators; }
+
     const Group *find_group(const std::string &id) const
     {
         for (auto i = groups.begin(); i != groups.end(); ++i) {
@@ -717,6 +1319,10 @@ public:
 
     Group *find_group(int test_num)
     {
+        if (!test_groups.empty()) {
+            if (test_num < table_first || test_num - table_first >= int(test_groups.size())) return NULL;
+            return &groups[test_groups[test_num - table_first]];
+        }
         for (auto i = groups.begin(); i != groups.end(); ++i) {
             if (i->get_first() <= test_num && test_num <= i->get_last())
                 return &(*i);
@@ -724,140 +1330,267 @@ public:
         return NULL;
     }
 
+    const Group *find_group(int test_num) const
+    {
+        return const_cast<ConfigParser *>(this)->find_group(test_num);
+    }
+
     const std::vector<Group> &get_groups() const { return groups; }
-};
+    std::vector<Group> &get_groups() { return groups; }
 
-void ConfigParser::parse_error(const std::string &msg) const
-{
-    fprintf(stderr, "%s: %d: %d: parse error: %s\n", path.c_str(), t_line, t_pos, msg.c_str());
-    exit(RUN_CHECK_FAILED);
-}
+    uint64_t get_config_hash() const { return config_hash; }
 
-void ConfigParser::scan_error(const std::string &msg) const
-{
-    fprintf(stderr, "%s: %d: %d: scan error: %s\n", path.c_str(), c_line, c_pos, msg.c_str());
-    exit(RUN_CHECK_FAILED);
-}
+    /*
+     * A compiled config cache: "GVK1", CONFIG_CACHE_VERSION as int32, the
+     * hash of the config text as two int32, then the groups and the
+     * generators, each as a count followed by the save_config records.
+     */
+    std::string save_cache() const
+    {
+        std::string buf("GVK1", 4);
+        put_int32(buf, CONFIG_CACHE_VERSION);
+        put_int32(buf, int32_t(config_hash));
+        put_int32(buf, int32_t(config_hash >> 32));
+        put_int32(buf, groups.size());
+        for (const Group &g : groups) g.save_config(buf);
+        put_int32(buf, generators.size());
+        for (const GroupGenerator &gen : generators) gen.save_config(buf);
+        return buf;
+    }
 
-bool Group::meet_requirements(const ConfigParser &cfg, const Group *&grp) const
-{
-    if (requires.size() <= 0) {
-        grp = NULL;
+    // returns false if the cache is not of this version or of the config with the given hash
+    bool load_cache(const char *buf, size_t size, uint64_t hash, const std::string &configpath)
+    {
+        if (size < 16 || memcmp(buf, "GVK1", 4) != 0) return false;
+        CacheReader in(buf + 4, size - 4);
+        if (in.get_int32() != CONFIG_CACHE_VERSION) return false;
+        uint64_t cache_hash = uint32_t(in.get_int32());
+        cache_hash |= uint64_t(uint32_t(in.get_int32())) << 32;
+        if (cache_hash != hash) return false;
+
+        path = configpath;
+        config_hash = hash;
+        test_groups.clear();
+        decisions.clear();
+        groups.clear();
+        generators.clear();
+        for (int n = in.get_int32(); n > 0; --n) {
+            groups.emplace_back();
+            groups.back().load_config(in);
+        }
+        for (int n = in.get_int32(); n > 0; --n) {
+            generators.emplace_back();
+            generators.back().load_config(in);
+        }
+        if (!in.at_end()) fail("invalid cache");
         return true;
     }
-    int i;
-    const Group *gg = NULL;
-    for (i = 0; i < int(requires.size()); ++i) {
-        gg = cfg.find_group(requires[i]);
-        if (gg == NULL) die("group %s not found", requires[i].c_str());
-        if (!gg->is_passed()) break;
-    }
-    if (i >= int(requires.size())) {
-        grp = NULL;
-        return true;
+
+    int get_group_index(const Group *g) const { return int(g - groups.data()); }
+
+    // valid once the groups are expanded
+    const GroupDecision &get_decision(const Group *g) const { return decisions[get_group_index(g)]; }
+    std::vector<char> &get_hint_passes() { return hint_passes; }
+    size_t get_comment_bound() const { return comment_bound; }
+    size_t get_judge_comment_bound() const { return judge_comment_bound; }
+
+    void reset_state()
+    {
+        for (Group &g : groups) g.reset_state();
     }
-    grp = gg;
-    return false;
+};
+
+void ConfigParser::parse_error(const std::string &msg) const
+{
+    fail("%s: %d: %d: parse error: %s", path.c_str(), t_line, t_pos, msg.c_str());
 }
 
-void parse_args(int argc, char** argv, std::string& selfdir, std::string& self)
+void ConfigParser::scan_error(const std::string &msg) const
 {
-    if (argc == 3) {
-        size_t pos = self.find_last_of('/');
-        if (pos == std::string::npos) {
-            char buf[PATH_MAX];
-            if (!getcwd(buf, sizeof(buf))) die("getcwd() failed");
-            selfdir = buf;
-        } else if (pos == 0) {
-            die("won't work in the root directory");
-        } else if (self[0] == '/') {
-            selfdir = self.substr(0, pos);
-        } else {
-            char buf[PATH_MAX];
-            if (!getcwd(buf, sizeof(buf))) die("getcwd() failed");
-            selfdir = buf;
-            if (selfdir != "/") selfdir += '/';
-            selfdir += self.substr(0, pos);
+    fail("%s: %d: %d: scan error: %s", path.c_str(), c_line, c_pos, msg.c_str());
+}
+
+bool Group::meet_requirements(const ConfigParser &cfg, const Group *&grp) const
+{
+    grp = NULL;
+    for (int r : cfg.get_decision(this).requires) {
+        const Group *gg = &cfg.get_groups()[r];
+        if (!gg->is_passed()) {
+            grp = gg;
+            return false;
         }
-    } else {
-        selfdir = argv[3];
     }
+    return true;
 }
 
-void environment_setup()
+/*
+ * Appends the comment of a group made from its skip reason. The run only
+ * records the reasons, the comments are made when the results are counted.
+ */
+static void append_skip_comment(std::string &out, const Group *test_group, const ConfigParser &parser,
+                                const ValuerOptions &options)
 {
-    if (!getenv("EJUDGE")) die("EJUDGE environment variable must be std::set");
-    if (getenv("EJUDGE_USER_SCORE")) user_score_flag = true;
-    if (getenv("EJUDGE_MARKED")) marked_flag = true;
-    if (getenv("EJUDGE_INTERACTIVE")) interactive_flag = true;
-    if (getenv("EJUDGE_REJUDGE")) rejudge_flag = true;
-    {
-        char *ls = getenv("EJUDGE_LOCALE");
-        if (ls) {
-            try {
-                locale_id = std::stoi(ls);
-            } catch (...) {
+    char buf[BUF_SIZE];
+    int test_num = test_group->get_skip_param();
+    const Group *required = NULL;
+    if (test_group->get_skip_reason() == SKIP_REQUIRES) required = &parser.get_groups()[test_num];
+
+    switch (test_group->get_skip_reason()) {
+    case SKIP_ZERO_SET:
+        if (options.locale_id == 1) {
+            snprintf(buf, sizeof(buf), 
+                "Группа тестов %s (%d-%d) оценена в 0 баллов, "
+                "так как были пройдены только специальные тесты.\n",
+                test_group->get_group_id().c_str(), 
+                test_group->get_first(), 
+                test_group->get_last());
+        } else {
+            snprintf(buf, sizeof(buf), 
+                "Test group %s (%d-%d) is scored 0 points "
+                "because only specific tests were passed.\n",
+                test_group->get_group_id().c_str(), 
+                test_group->get_first(),
+                test_group->get_last());
+        }
+        break;
+
+    case SKIP_TEST_STOP:
+        if (test_group->get_offline()) return;
+        if (options.locale_id == 1) {
+            snprintf(buf, sizeof(buf), "Тестирование на тестах %d-%d не выполнялось, "
+                     "так как тест %d не пройден, и оценка за группу тестов %s - 0 баллов.\n",
+                     test_num + 1, 
+                     test_group->get_last(), 
+                     test_num, 
+                     test_group->get_group_id().c_str());
+        } else {
+            snprintf(buf, sizeof(buf), "Testing on tests %d-%d has not been performed, "
+                     "as test %d has not passed, and test group '%s' score is 0.\n",
+                     test_num + 1, 
+                     test_group->get_last(), 
+                     test_num, 
+                     test_group->get_group_id().c_str());
+        }
+        break;
+
+    case SKIP_DECIDED:
+        if (test_group->get_offline()) return;
+        if (options.locale_id == 1) {
+            snprintf(buf, sizeof(buf), "Тестирование на тестах %d-%d не выполнялось, "
+                     "так как результат группы тестов %s уже известен.\n",
+                     test_num,
+                     test_group->get_last(),
+                     test_group->get_group_id().c_str());
+        } else {
+            snprintf(buf, sizeof(buf), "Testing on tests %d-%d has not been performed, "
+                     "as the result of test group '%s' is already known.\n",
+                     test_num,
+                     test_group->get_last(),
+                     test_group->get_group_id().c_str());
+        }
+        break;
+
+    case SKIP_TARGET:
+        if (test_group->get_offline()) return;
+        if (options.locale_id == 1) {
+            snprintf(buf, sizeof(buf), "Тестирование на тестах %d-%d не выполнялось, "
+                     "так как уже известно, превышен ли целевой балл.\n",
+                     test_group->get_first(),
+                     test_group->get_last());
+        } else {
+            snprintf(buf, sizeof(buf), "Testing on tests %d-%d has not been performed, "
+                     "as it is already known whether the target score is exceeded.\n",
+                     test_group->get_first(),
+                     test_group->get_last());
+        }
+        break;
+
+    case SKIP_REQUIRES:
+        if (!test_group->get_offline()) {
+            if (options.locale_id == 1) {
+                snprintf(buf, sizeof(buf), 
+                    "Тестирование на тестах %d-%d не выполнялось, "
+                    "так как не пройдена одна из требуемых групп %s.\n",
+                    test_group->get_first(),
+                    test_group->get_last(), 
+                    required->get_group_id().c_str());
+            } else {
+                snprintf(buf, sizeof(buf), 
+                    "Testing on tests %d-%d has not been performed, "
+                    "as one of the required groups '%s' has not passed.\n",
+                    test_group->get_first(), 
+                    test_group->get_last(), 
+                    required->get_group_id().c_str());
+            }
+        } else if (!required->get_offline()) {
+            if (options.locale_id == 1) {
+                snprintf(buf, sizeof(buf), 
+                    "Тестирование на тестах %d-%d не будет выполняться после окончания тура, "
+                    "так как не пройдена одна из требуемых групп %s.\n",
+                    test_group->get_first(), 
+                    test_group->get_last(), 
+                    required->get_group_id().c_str());
+            } else {
+                snprintf(buf, sizeof(buf), 
+                    "Testing on tests %d-%d will not be performed after the tour finish, "
+                    "as one of the required groups '%s' has not passed.\n",
+                    test_group->get_first(), 
+                    test_group->get_last(), 
+                    required->get_group_id().c_str());
             }
-            if (locale_id < 0) locale_id = 0;
+        } else {
+            return;
         }
+        break;
+
+    default:
+        return;
     }
+
+    out += buf;
 }
 
-void handle_bytest_score(Group *test_group, int test_num)
+static void handle_bytest_score(Group *test_group, int test_num)
 {
     if (test_num == test_group->get_last()) {
         if (test_group->is_zero_set()) {
-            char buf[BUF_SIZE];
-            if (locale_id == 1) {
-                snprintf(buf, sizeof(buf), 
-                    "Группа тестов %s (%d-%d) оценена в 0 баллов, "
-                    "так как были пройдены только специальные тесты.\n",
-                    test_group->get_group_id().c_str(), 
-				            test_group->get_first(), 
-				            test_group->get_last());
-            } else {
-                snprintf(buf, sizeof(buf), 
-                    "Test group %s (%d-%d) is scored 0 points "
-                    "because only specific tests were passed.\n",
-                    test_group->get_group_id().c_str(), 
-				            test_group->get_first(),
-				            test_group->get_last());
-            }
-        
             test_group->set_total_score(0);
-            test_group->set_comment(std::string(buf));
+            test_group->set_skip_reason(SKIP_ZERO_SET);
         }
     }
 }
 
-void handle_test_stop(Group *test_group, int test_num)
+static void handle_test_stop(Group *test_group, int test_num)
 {
-    if (test_num < test_group->get_last() && !test_group->get_offline()) {
-        char buf[BUF_SIZE];
-        if (locale_id == 1) {
-            snprintf(buf, sizeof(buf), "Тестирование на тестах %d-%d не выполнялось, "
-                             "так как тест %d не пройден, и оценка за группу тестов %s - 0 баллов.\n",
-                             test_num + 1, 
-			     test_group->get_last(), 
-			     test_num, 
-			     test_group->get_group_id().c_str());
-            } else {
-                    snprintf(buf, sizeof(buf), "Testing on tests %d-%d has not been performed, "
-                             "as test %d has not passed, and test group '%s' score is 0.\n",
-                             test_num + 1, 
-			     test_group->get_last(), 
-			     test_num, 
-			     test_group->get_group_id().c_str());
-            }
-            test_group->set_comment(std::string(buf));
+    if (test_num < test_group->get_last()) {
+        test_group->set_skip_reason(SKIP_TEST_STOP, test_num);
     }
 }
 
-int analyse_test_group(Group *test_group, int& test_num, int t_status)
+static void handle_decided_stop(Group *test_group, int test_num)
 {
-    if (test_group == NULL) die("unexpected test number %d", test_num);
+    if (test_num <= test_group->get_last()) {
+        test_group->set_skip_reason(SKIP_DECIDED, test_num);
+    }
+}
 
-    if (t_status == RUN_OK) {
+static int analyse_test_group(Group *test_group, int& test_num, int t_status)
+{
+    if (test_group == NULL) fail("unexpected test number %d", test_num);
+
+    test_group->inc_tested_count();
+    if (test_group->get_stop_if_decided()) {
+        // go on until pass_if_count is either reached or out of reach
+        if (t_status == RUN_OK) {
+            test_group->inc_passed_count();
+            test_group->add_passed_test(test_num);
+        }
+        ++test_num;
+        if (test_group->is_decided(test_num)) {
+            handle_decided_stop(test_group, test_num);
+            test_num = test_group->get_last() + 1;
+        }
+    } else if (t_status == RUN_OK) {
         // just go to the next test...
         test_group->inc_passed_count();
         test_group->add_total_score();
@@ -874,84 +1607,42 @@ int analyse_test_group(Group *test_group, int& test_num, int t_status)
         test_num = test_group->get_last() + 1;
     }
 
-    if (test_num <= test_group->get_last()) {
-        printf("%d\n", -1);
-        fflush(stdout);
-        return CONTINUE_READING;
-    }
+    if (test_num <= test_group->get_last()) return CONTINUE_READING;
 
     return GROUP_READY;
 }
 
-void parse_with_requirements(Group *g, const Group *gg, int &test_num, ConfigParser &parser)
+static void parse_with_requirements(Group *g, const Group *gg, int &test_num, ConfigParser &parser)
 {
     while ((g = parser.find_group(test_num)) && !g->meet_requirements(parser, gg)) {
-        if (!g->get_offline()) {
-            char buf[BUF_SIZE];
-            if (locale_id == 1) {
-                    snprintf(buf, sizeof(buf), 
-                      "Тестирование на тестах %d-%d не выполнялось, "
-                      "так как не пройдена одна из требуемых групп %s.\n",
-                      g->get_first(),
-			                g->get_last(), 
-			                gg->get_group_id().c_str());
-            } else {
-                snprintf(buf, sizeof(buf), 
-                  "Testing on tests %d-%d has not been performed, "
-                  "as one of the required groups '%s' has not passed.\n",
-                   g->get_first(), 
-			             g->get_last(), 
-			             gg->get_group_id().c_str());
-            }
-
-            g->set_comment(std::string(buf));
-
-        } else if (g->get_offline() && !gg->get_offline()) {
-            char buf[BUF_SIZE];
-            if (locale_id == 1) {
-                snprintf(buf, sizeof(buf), 
-                   "Тестирование на тестах %d-%d не будет выполняться после окончания тура, "
-                   "так как не пройдена одна из требуемых групп %s.\n",
-                   g->get_first(), 
-			             g->get_last(), 
-			             gg->get_group_id().c_str());
-            } else {
-                snprintf(buf, sizeof(buf), 
-                  "Testing on tests %d-%d will not be performed after the tour finish, "
-                  "as one of the required groups '%s' has not passed.\n",
-                  g->get_first(), 
-			            g->get_last(), 
-			            gg->get_group_id().c_str());
-            }
-
-            g->set_comment(std::string(buf));
-	      }
-
+        g->set_skip_reason(SKIP_REQUIRES, parser.get_group_index(gg));
         test_num = g->get_last() + 1;
     }
 }
 
-void skip_rejudge_groups(Group *g, int &test_num, ConfigParser &parser)
+static void skip_rejudge_groups(Group *g, int &test_num, ConfigParser &parser, const ValuerOptions &options)
 {
-    while ((g = parser.find_group(test_num))
-               && (g->get_skip() || (g->get_skip_if_not_rejudge() && !rejudge_flag))) {
-            test_num = g->get_last() + 1;
+    if (!(g = parser.find_group(test_num))) return;
+    int run_from = parser.get_decision(g).run_from[options.rejudge];
+    while (test_num < run_from && (g = parser.find_group(test_num))) {
+        g->set_skip_reason(SKIP_CONFIG);
+        test_num = g->get_last() + 1;
     }
 }
 
-void print_group_score(const Group &g, FILE *fjcmt, FILE *fcmt)
+static void print_group_score(const Group &g, ValuerResult &result, const ValuerOptions &options)
 {
     int group_score = g.calc_score();
     
     if (g.get_stat_to_judges()) {
-        if (locale_id == 1) {
-            fprintf(fjcmt, "Группа тестов %s: тесты %d-%d: балл %d\n",
+        if (options.locale_id == 1) {
+            append_printf(result.judge_comment, "Группа тестов %s: тесты %d-%d: балл %d\n",
                 g.get_group_id().c_str(),
                 g.get_first(),
                 g.get_last(),
                 group_score);
         } else {
-            fprintf(fjcmt, "Test group '%s': tests %d-%d: score %d\n",
+            append_printf(result.judge_comment, "Test group '%s': tests %d-%d: score %d\n",
                 g.get_group_id().c_str(),
                 g.get_first(),
                 g.get_last(),
@@ -960,14 +1651,14 @@ void print_group_score(const Group &g, FILE *fjcmt, FILE *fcmt)
     }
 
     if (g.get_stat_to_users() && !g.get_offline()) {
-        if (locale_id == 1) {
-            fprintf(fcmt, "Группа тестов %s: тесты %d-%d: балл %d\n",
+        if (options.locale_id == 1) {
+            append_printf(result.comment, "Группа тестов %s: тесты %d-%d: балл %d\n",
                 g.get_group_id().c_str(),
                 g.get_first(),
                 g.get_last(),
                 group_score);
         } else {
-            fprintf(fcmt, "Test group '%s': tests %d-%d: score %d\n",
+            append_printf(result.comment, "Test group '%s': tests %d-%d: score %d\n",
                 g.get_group_id().c_str(),
                 g.get_first(),
                 g.get_last(),
@@ -976,122 +1667,2023 @@ void print_group_score(const Group &g, FILE *fjcmt, FILE *fcmt)
     }
 }
 
-void analyse_sets_marker_vector(const std::vector<std::string> &smv, int &valuer_marked, ConfigParser &parser)
+static bool analyse_sets_marker_vector(const std::vector<int> &smv, const ConfigParser &parser)
 {
-    if (smv.size() > 0) {
-        bool failed = false;
-        for (const std::string &gn : smv) {
-            const Group *pg2 = parser.find_group(gn);
-            if (!pg2 || !pg2->is_passed()) {
-                    failed = true;
-                }
-            }
+    if (smv.size() <= 0) return false;
 
-        if (!failed) valuer_marked = 1;
+    for (int r : smv) {
+        if (r < 0 || !parser.get_groups()[r].is_passed()) return false;
     }
+    return true;
+}
+
+static bool group_marks_run(const Group &g, const ConfigParser &parser)
+{
+    if (g.get_sets_marked() && g.is_passed()) return true;
+    return analyse_sets_marker_vector(parser.get_decision(&g).marks_if_passed, parser);
 }
 
-void add_score(int &score, 
-		int &user_score, 
-		int &user_status,
-		int &user_tests_passed,
-		int group_score, 
-		const Group &g)
+static void add_score(ValuerResult &summary, int group_score, const Group &g)
 {
     if (g.get_offline()) {
-        score += group_score;
+        summary.score += group_score;
     } else {
-        user_tests_passed += g.get_passed_count();
-        score += group_score;
-        user_score += group_score;
+        summary.user_tests_passed += g.get_passed_count();
+        summary.score += group_score;
+        summary.user_score += group_score;
         if (!g.is_passed()) {
-            user_status = RUN_PARTIAL;
+            summary.user_status = RUN_PARTIAL;
         } else if (g.get_user_status() >= 0) {
-            user_status = g.get_user_status();
+            summary.user_status = g.get_user_status();
         }
     }
 }
 
-void count_groups_score(ConfigParser &parser, int &valuer_marked, FILE *fcmt, FILE *fjcmt)
+static void write_iov(int fd, struct iovec *iov, int iovcnt)
 {
-    int score = 0, user_status = RUN_OK, user_score = 0, user_tests_passed = 0;
-    for (const Group &g : parser.get_groups()) {
-        if (g.has_comment()) {
-            fprintf(fcmt, "%s", g.get_comment().c_str());
+    while (iovcnt > 0) {
+        ssize_t r = writev(fd, iov, iovcnt);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            fail("write failed: %s", strerror(errno));
+        }
+        size_t done = r;
+        while (iovcnt > 0 && done >= iov->iov_len) {
+            done -= iov->iov_len;
+            ++iov;
+            --iovcnt;
         }
-        if (g.get_sets_marked() && g.is_passed()) {
-            valuer_marked = 1;
+        if (iovcnt > 0) {
+            iov->iov_base = (char *) iov->iov_base + done;
+            iov->iov_len -= done;
         }
+    }
+}
 
-        const std::vector<std::string> &smv = g.get_sets_marked_if_passed();
-        analyse_sets_marker_vector(smv, valuer_marked, parser);
+/*
+ * The structured report is a machine-readable copy of the run result.
+ * All integers are little-endian.
+ *
+ *   header: char magic[4] = "GVR1"; int32 group_count; int32 score;
+ *           int32 marked; int32 user_status; int32 user_score;
+ *           int32 user_tests_passed;
+ *   then group_count records:
+ *           int32 first; int32 last; int32 passed_count; int32 tested_count;
+ *           int32 score; int32 skip_param; uint8 status (GROUP_*);
+ *           uint8 skip_reason (SKIP_*); uint8 flags (REPORT_*); uint8 reserved;
+ *           int32 id_length; char id[id_length];
+ */
+static void write_report(const char *path, const ConfigParser &parser, const ValuerResult &summary)
+{
+    const std::vector<Group> &groups = parser.get_groups();
+
+    std::string header("GVR1", 4);
+    put_int32(header, groups.size());
+    put_int32(header, summary.score);
+    put_int32(header, summary.marked);
+    put_int32(header, summary.user_status);
+    put_int32(header, summary.user_score);
+    put_int32(header, summary.user_tests_passed);
+
+    std::string body;
+    for (const Group &g : groups) {
+        int flags = 0;
+        if (g.get_offline()) flags |= REPORT_OFFLINE;
+        if (g.get_sets_marked()) flags |= REPORT_SETS_MARKED;
+        if (group_marks_run(g, parser)) flags |= REPORT_MARKED;
+
+        put_int32(body, g.get_first());
+        put_int32(body, g.get_last());
+        put_int32(body, g.get_passed_count());
+        put_int32(body, g.get_tested_count());
+        put_int32(body, g.calc_score());
+        put_int32(body, g.get_skip_param());
+        body += char(g.get_status());
+        body += char(g.get_skip_reason());
+        body += char(flags);
+        body += char(0);
+        put_int32(body, g.get_group_id().length());
+        body += g.get_group_id();
+    }
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) fail("cannot open file '%s' for writing", path);
+    struct iovec iov[2] = {
+        { (void *) header.data(), header.size() },
+        { (void *) body.data(), body.size() },
+    };
+    write_iov(fd, iov, 2);
+    if (close(fd) < 0) fail("cannot write file '%s'", path);
+}
+
+static void count_groups_score(ConfigParser &parser, ValuerResult &result, const ValuerOptions &options)
+{
+    for (const Group &g : parser.get_groups()) {
+        append_skip_comment(result.comment, &g, parser, options);
+        if (group_marks_run(g, parser)) {
+            result.marked = 1;
+        }
 
         int group_score = g.calc_score();
-        print_group_score(g, fjcmt, fcmt);
+        print_group_score(g, result, options);
 
-        add_score(score, user_score, user_status, 
-                        user_tests_passed, group_score, g);
+        add_score(result, group_score, g);
     }
+}
+
+/*
+ * Tells the judge the tests it is likely to be asked for next, starting
+ * with test_num, so that it can stage their data in advance: a line of
+ * test numbers on options.hint_fd. The groups to come are predicted the
+ * way next_group_test moves on, the requirements first and then the
+ * groups the config skips, with the current group and the groups yet to
+ * be tested expected to pass. Hints that don't fit in the pipe are lost.
+ */
+static void write_hints(ConfigParser &parser, int test_num, const ValuerOptions &options)
+{
+    std::vector<char> &passes = parser.get_hint_passes();
+    const std::vector<Group> &groups = parser.get_groups();
+    auto meets_requirements = [&](const Group *g) {
+        for (int r : parser.get_decision(g).requires) {
+            if (groups[r].get_last() < test_num ? !groups[r].is_passed() : !passes[r]) return false;
+        }
+        return true;
+    };
 
-    printf("%d", score);
-    if (marked_flag) {
-        printf(" %d", valuer_marked);
+    char buf[BUF_SIZE];
+    int len = snprintf(buf, sizeof(buf), "%d", test_num);
+    int count = 1;
+    int t = test_num + 1;
+    const Group *g = parser.find_group(test_num);
+    while (g && count < options.hint_count) {
+        passes[parser.get_group_index(g)] = 1;
+        for (; t <= g->get_last() && count < options.hint_count && len + 16 < int(sizeof(buf)); ++t, ++count) {
+            len += snprintf(buf + len, sizeof(buf) - len, " %d", t);
+        }
+        t = g->get_last() + 1;
+        while ((g = parser.find_group(t)) && !meets_requirements(g)) {
+            passes[parser.get_group_index(g)] = 0;
+            t = g->get_last() + 1;
+        }
+        if (!g) break;
+        int run_from = parser.get_decision(g).run_from[options.rejudge];
+        while (t < run_from && (g = parser.find_group(t))) {
+            passes[parser.get_group_index(g)] = 0;
+            t = g->get_last() + 1;
+        }
+        g = parser.find_group(t);
     }
-    if (user_score_flag) {
-        printf(" %d %d %d", user_status, user_score, user_tests_passed);
+    buf[len++] = '\n';
+    while (write(options.hint_fd, buf, len) < 0 && errno == EINTR) {
     }
-    printf("\n");
-    fflush(stdout);
 }
 
-void scan_tests(ConfigParser &parser)
+/*
+ * The checkpoint file keeps the scoring state of a run after every verdict,
+ * so that a run interrupted by a crash goes on from the next test instead
+ * of the first one. The file is mapped into memory and has a fixed layout
+ * in the host byte order: CheckpointHeader, then two slots of slot_size
+ * bytes, each being CheckpointSlot, group_count CheckpointGroup records
+ * and the passed tests of all the groups as bitmaps of 64-bit words.
+ * The slots are written in turn; the newest slot with the right checksum
+ * is the state to resume from. A slot reaches the disk before the reply
+ * to the judge, so that neither a crash of the valuer nor one of the host
+ * reruns a test. Comments are not stored, they are made from the skip
+ * reasons.
+ */
+struct CheckpointHeader
+{
+    char magic[4];
+    uint32_t group_count;
+    uint64_t config_hash;
+    uint32_t slot_size;
+    uint32_t reserved;
+};
+
+struct CheckpointSlot
 {
-    int test_num = 1, t_status = 0, t_score = 0, t_time = 0;
-    while (scanf("%d%d%d", &t_status, &t_score, &t_time) == 3) {
-        Group *g = parser.find_group(test_num);
-        if (analyse_test_group(g, test_num, t_status) == CONTINUE_READING) continue;
+    uint64_t sequence;
+    uint64_t checksum;          // of the slot after this field
+    int32_t test_num;           // the next test to run
+    int32_t reserved;
+};
 
-        const Group *gg = NULL;
-        parse_with_requirements(g, gg, test_num, parser);
-        skip_rejudge_groups(g, test_num, parser);
+struct CheckpointGroup
+{
+    int32_t passed_count;
+    int32_t tested_count;
+    int32_t total_score;
+    int32_t skip_reason;
+    int32_t skip_param;
+    int32_t reserved;
+};
 
-        printf("%d\n", -test_num);
-        fflush(stdout);
+class Checkpoint
+{
+    int fd = -1;
+    unsigned char *map = NULL;
+    size_t map_size = 0;
+    size_t slot_size = 0;
+    uint64_t sequence = 0;
+
+    unsigned char *slot(int i) const { return map + sizeof(CheckpointHeader) + i * slot_size; }
+
+    // writes the bytes [begin, end) of the map to the disk
+    void sync(const unsigned char *begin, const unsigned char *end) const
+    {
+        size_t page = sysconf(_SC_PAGESIZE);
+        size_t offset = (begin - map) / page * page;
+        if (msync(map + offset, end - (map + offset), MS_SYNC) < 0)
+            fail("cannot sync checkpoint file: %s", strerror(errno));
     }
-}
 
-int main(int argc, char *argv[])
+    static uint64_t slot_checksum(const unsigned char *s, size_t size)
+    {
+        uint64_t hash = fnv1a64(s, sizeof(uint64_t));
+        return fnv1a64(s + 2 * sizeof(uint64_t), size - 2 * sizeof(uint64_t), hash);
+    }
+
+public:
+    Checkpoint() {}
+    Checkpoint(const Checkpoint &) = delete;
+    Checkpoint &operator=(const Checkpoint &) = delete;
+
+    ~Checkpoint()
+    {
+        if (map) munmap(map, map_size);
+        if (fd >= 0) close(fd);
+    }
+
+    bool is_open() const { return map != NULL; }
+
+    // keep tells to keep the saved state if it matches the config
+    void open(const char *path, const ConfigParser &parser, bool keep)
+    {
+        const std::vector<Group> &groups = parser.get_groups();
+        size_t words = 0;
+        for (const Group &g : groups) words += g.get_bitmap_words();
+        slot_size = sizeof(CheckpointSlot) + groups.size() * sizeof(CheckpointGroup) + words * sizeof(uint64_t);
+        map_size = sizeof(CheckpointHeader) + 2 * slot_size;
+
+        fd = ::open(path, O_RDWR | O_CREAT, 0644);
+        if (fd < 0) fail("cannot open checkpoint file '%s': %s", path, strerror(errno));
+        struct stat st;
+        if (fstat(fd, &st) < 0) fail("cannot stat checkpoint file '%s'", path);
+        if (size_t(st.st_size) != map_size) {
+            keep = false;
+            if (ftruncate(fd, 0) < 0 || ftruncate(fd, map_size) < 0)
+                fail("cannot resize checkpoint file '%s'", path);
+        }
+        void *addr = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED) fail("cannot map checkpoint file '%s': %s", path, strerror(errno));
+        map = (unsigned char *) addr;
+
+        CheckpointHeader *header = (CheckpointHeader *) map;
+        if (memcmp(header->magic, "GVC1", 4) != 0
+            || header->group_count != groups.size()
+            || header->config_hash != parser.get_config_hash()
+            || header->slot_size != slot_size) {
+            keep = false;
+        }
+        if (!keep) {
+            memset(map, 0, map_size);
+            memcpy(header->magic, "GVC1", 4);
+            header->group_count = groups.size();
+            header->config_hash = parser.get_config_hash();
+            header->slot_size = slot_size;
+            sync(map, map + map_size);
+        }
+    }
+
+    // returns false when there is no state to resume from
+    bool restore(ConfigParser &parser, int &test_num)
+    {
+        int newest = -1;
+        for (int i = 0; i < 2; ++i) {
+            const CheckpointSlot *cs = (const CheckpointSlot *) slot(i);
+            if (cs->sequence == 0 || cs->checksum != slot_checksum(slot(i), slot_size)) continue;
+            if (newest < 0 || cs->sequence > ((const CheckpointSlot *) slot(newest))->sequence) newest = i;
+        }
+        if (newest < 0) return false;
+
+        const unsigned char *s = slot(newest);
+        const CheckpointSlot *cs = (const CheckpointSlot *) s;
+        const CheckpointGroup *records = (const CheckpointGroup *) (s + sizeof(CheckpointSlot));
+        std::vector<Group> &groups = parser.get_groups();
+        const uint64_t *bits = (const uint64_t *) (records + groups.size());
+
+        for (int i = 0; i < int(groups.size()); ++i) {
+            Group &g = groups[i];
+            const CheckpointGroup &r = records[i];
+            g.restore_state(r.passed_count, r.tested_count, r.total_score, r.skip_reason, r.skip_param);
+            int size = g.get_last() - g.get_first() + 1;
+            for (int t = 0; t < size; ++t) {
+                if (bits[t / 64] & (uint64_t(1) << (t % 64))) g.add_passed_test(g.get_first() + t);
+            }
+            bits += g.get_bitmap_words();
+        }
+        for (const Group &g : groups) {
+            if (g.get_skip_reason() == SKIP_REQUIRES && (g.get_skip_param() < 0 || g.get_skip_param() >= int(groups.size())))
+                fail("invalid checkpoint");
+        }
+        test_num = cs->test_num;
+        sequence = cs->sequence;
+        return true;
+    }
+
+    void save(const ConfigParser &parser, int test_num)
+    {
+        unsigned char *s = slot((sequence + 1) % 2);
+        CheckpointSlot *cs = (CheckpointSlot *) s;
+        CheckpointGroup *records = (CheckpointGroup *) (s + sizeof(CheckpointSlot));
+        const std::vector<Group> &groups = parser.get_groups();
+        uint64_t *bits = (uint64_t *) (records + groups.size());
+
+        cs->test_num = test_num;
+        for (int i = 0; i < int(groups.size()); ++i) {
+            const Group &g = groups[i];
+            CheckpointGroup &r = records[i];
+            r.passed_count = g.get_passed_count();
+            r.tested_count = g.get_tested_count();
+            r.total_score = g.get_total_score();
+            r.skip_reason = g.get_skip_reason();
+            r.skip_param = g.get_skip_param();
+            int words = g.get_bitmap_words();
+            memcpy(bits, g.get_passed_bits().data(), words * sizeof(uint64_t));
+            bits += words;
+        }
+        cs->sequence = ++sequence;
+        cs->checksum = slot_checksum(s, slot_size);
+        sync(s, s + slot_size);
+    }
+};
+
+/*
+ * Verdicts of whole groups kept on disk from run to run, so that a
+ * rejudge or a resubmission of the same code doesn't run the tests of a
+ * group again while neither the group nor its tests change. A group is
+ * keyed by the submission hash, its config and the hashes of its tests.
+ * The file named by the key in hex has "GVV1", the count of verdicts and
+ * then the test number, status, score and time of each verdict, all as
+ * little-endian int32. A group is taken from the cache only before its
+ * first test is run, and stored only if all its tests ran in this run.
+ */
+class VerdictCache
 {
-    if (argc < 3 || argc > 4) die("invalid number of arguments");
-    
-    int valuer_marked = 0;
+    struct CachedVerdict
+    {
+        int test_num;
+        ValuerVerdict verdict;
+    };
 
-    std::string self(argv[0]);
-    std::string selfdir;
-    parse_args(argc, argv, selfdir, self);
-    
-    environment_setup();
+    const char *dir = NULL;
+    std::vector<uint64_t> keys;             // of the groups, 0 when not cached
+    std::vector<CachedVerdict> verdicts;    // of the group being run or replayed
+    std::vector<unsigned char> io;
+    const Group *recording = NULL;
 
-    std::string configpath = selfdir + "/valuer.cfg";
-    ConfigParser parser;
-    parser.parse(configpath);
+    void make_path(char *buf, size_t size, uint64_t key) const
+    {
+        snprintf(buf, size, "%s/%016llx", dir, (unsigned long long) key);
+    }
+
+    bool load(uint64_t key)
+    {
+        char path[PATH_MAX];
+        make_path(path, sizeof(path), key);
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        bool ok = fstat(fd, &st) >= 0 && st.st_size >= 8 && size_t(st.st_size) <= io.size();
+        size_t size = ok ? st.st_size : 0, done = 0;
+        while (ok && done < size) {
+            ssize_t r = read(fd, io.data() + done, size - done);
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) ok = false;
+            else done += r;
+        }
+        close(fd);
+        if (!ok || memcmp(io.data(), "GVV1", 4) != 0) return false;
+        int count = load_int32(io.data() + 4);
+        if (count <= 0 || size != 8 + 16 * size_t(count)) return false;
+
+        verdicts.clear();
+        for (const unsigned char *p = io.data() + 8; p < io.data() + size; p += 16) {
+            CachedVerdict cv;
+            cv.test_num = load_int32(p);
+            cv.verdict.status = load_int32(p + 4);
+            cv.verdict.score = load_int32(p + 8);
+            cv.verdict.time = load_int32(p + 12);
+            verdicts.push_back(cv);
+        }
+        return true;
+    }
+
+public:
+    bool is_open() const { return dir != NULL; }
+
+    void open(const ConfigParser &parser, const ValuerOptions &options)
+    {
+        if (!options.submission_hash || !options.test_hashes_path) fail("no hashes for the verdict cache");
+        FILE *f = fopen(options.test_hashes_path, "r");
+        if (!f) fail("cannot open file '%s'", options.test_hashes_path);
+        std::vector<std::string> test_hashes;
+        char *line = NULL;
+        size_t line_size = 0;
+        ssize_t len;
+        while ((len = getline(&line, &line_size, f)) >= 0) {
+            while (len > 0 && isspace((unsigned char) line[len - 1])) --len;
+            test_hashes.emplace_back(line, len);
+        }
+        free(line);
+        fclose(f);
+
+        const std::vector<Group> &groups = parser.get_groups();
+        keys.assign(groups.size(), 0);
+        int max_size = 1;
+        for (int i = 0; i < int(groups.size()); ++i) {
+            const Group &g = groups[i];
+            max_size = std::max(max_size, g.get_last() - g.get_first() + 1);
+            // a group with a test of unknown data is not cached
+            if (g.get_first() < 1 || g.get_last() > int(test_hashes.size())) continue;
+            std::string config;
+            g.save_config(config);
+            uint64_t key = fnv1a64(options.submission_hash, strlen(options.submission_hash) + 1);
+            key = fnv1a64(config.data(), config.size(), key);
+            for (int t = g.get_first(); t <= g.get_last(); ++t) {
+                const std::string &h = test_hashes[t - 1];
+                key = fnv1a64(h.c_str(), h.size() + 1, key);
+            }
+            keys[i] = key ? key : 1;
+        }
+        verdicts.reserve(max_size);
+        io.resize(8 + 16 * size_t(max_size));
+        dir = options.verdict_cache_dir;
+        mkdir(dir, 0755);
+    }
+
+    // runs the group starting at test_num on its cached verdicts, if any
+    bool replay(ConfigParser &parser, int &test_num)
+    {
+        Group *g = parser.find_group(test_num);
+        if (!g || test_num != g->get_first() || g->get_tested_count() > 0) return false;
+        uint64_t key = keys[parser.get_group_index(g)];
+        if (!key || !load(key)) return false;
+
+        int t = test_num, state = CONTINUE_READING;
+        for (const CachedVerdict &cv : verdicts) {
+            if (state != CONTINUE_READING || cv.test_num != t) {
+                state = -1;
+                break;
+            }
+            state = analyse_test_group(g, t, cv.verdict.status);
+        }
+        if (state != GROUP_READY) {
+            // not the tests this group asks for, so it is run
+            g->reset_state();
+            return false;
+        }
+        test_num = t;
+        return true;
+    }
+
+    // the verdict of a test run by the judge, before it is analysed
+    void add(const Group *g, int test_num, const ValuerVerdict &verdict)
+    {
+        if (test_num == g->get_first() && g->get_tested_count() == 0) {
+            recording = g;
+            verdicts.clear();
+        }
+        if (recording != g) return;
+        if (verdicts.size() >= verdicts.capacity()) {
+            recording = NULL;
+            return;
+        }
+        verdicts.push_back({ test_num, verdict });
+    }
+
+    // stores the verdicts of g once the group is over, if all its tests were run
+    void store(const ConfigParser &parser, const Group *g)
+    {
+        if (recording != g) return;
+        recording = NULL;
+        uint64_t key = keys[parser.get_group_index(g)];
+        if (!key) return;
+
+        unsigned char *p = io.data();
+        memcpy(p, "GVV1", 4);
+        store_int32(p + 4, verdicts.size());
+        p += 8;
+        for (const CachedVerdict &cv : verdicts) {
+            store_int32(p, cv.test_num);
+            store_int32(p + 4, cv.verdict.status);
+            store_int32(p + 8, cv.verdict.score);
+            store_int32(p + 12, cv.verdict.time);
+            p += 16;
+        }
 
-    if (!interactive_flag) die("non-interactive mode not yet supported");
-    int total_count = -2;
-    if (scanf("%d", &total_count) != 1) die("expected the count of tests");
-    if (total_count != -1) die("count value must be -1");
+        // the cache is of no use to the run itself, so it is written best effort
+        // a temporary file of its own, as runs in other threads may store the same key
+        char path[PATH_MAX], tmp_path[PATH_MAX + 16];
+        make_path(path, sizeof(path), key);
+        snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", path);
+        int fd = mkstemp(tmp_path);
+        if (fd < 0) return;
+        fchmod(fd, 0644);
+        struct iovec iov = { io.data(), size_t(p - io.data()) };
+        bool ok = true;
+        try {
+            write_iov(fd, &iov, 1);
+        } catch (const ValuerError &) {
+            ok = false;
+        }
+        if (close(fd) < 0) ok = false;
+        if (!ok || rename(tmp_path, path) < 0) unlink(tmp_path);
+    }
+};
 
-    scan_tests(parser);
+/*
+ * Tells when the score of the run against options.target_score is known:
+ * above it once the groups that are over score more, not above it once
+ * even the best scores of the rest can't lift it over. Asked only when a
+ * group is over, so that the groups before are done and the rest is not
+ * started yet.
+ */
+class TargetTracker
+{
+    int next_group = 0;         // the groups before are over
+    int done_score = 0;
 
-    FILE *fcmt = fopen(argv[1], "w");
-    if (!fcmt) die("cannot open file '%s' for writing", argv[1]);
+public:
+    bool is_decided(const ConfigParser &parser, int test_num, int target)
+    {
+        const std::vector<Group> &groups = parser.get_groups();
+        while (next_group < int(groups.size()) && groups[next_group].get_last() < test_num) {
+            done_score += groups[next_group].calc_score();
+            ++next_group;
+        }
+        if (done_score > target) return true;
+        if (next_group >= int(groups.size())) return true;
+        return done_score + parser.get_decision(&groups[next_group]).max_score_from <= target;
+    }
+};
 
-    FILE *fjcmt = fopen(argv[2], "w");
-    if (!fjcmt) die("cannot open file '%s' for writing", argv[2]);
+static void skip_target_groups(int &test_num, ConfigParser &parser)
+{
+    Group *g;
+    while ((g = parser.find_group(test_num))) {
+        g->set_skip_reason(SKIP_TARGET);
+        test_num = g->get_last() + 1;
+    }
+}
 
-    count_groups_score(parser, valuer_marked, fcmt, fjcmt);
+// the first test to run once the group before test_num is over
+static int next_group_test(ConfigParser &parser, int test_num, const ValuerOptions &options)
+{
+    const Group *gg = NULL;
+    parse_with_requirements(NULL, gg, test_num, parser);
+    skip_rejudge_groups(NULL, test_num, parser, options);
+    return test_num;
 }
 
+/*
+ * Asks for verdicts from test first_test on. The judge is expected to
+ * start with test 1 by itself; any other first test is sent to it.
+ */
+static void scan_tests(ConfigParser &parser, const ValuerOptions &options,
+                       ValuerVerdictCallback callback, void *user, int first_test = 1)
+{
+    int test_num = first_test, reply = first_test != 1 ? -first_test : 0;
+    Checkpoint checkpoint;
+    if (options.checkpoint_path) {
+        checkpoint.open(options.checkpoint_path, parser, options.resume);
+        if (options.resume) checkpoint.restore(parser, test_num);
+    }
+    VerdictCache cache;
+    if (options.verdict_cache_dir) cache.open(parser, options);
+
+    TargetTracker target;
+    // moves on once the group before test_num is over, past the groups found in the cache
+    auto group_over = [&]() {
+        do {
+            test_num = next_group_test(parser, test_num, options);
+            if (options.target_score >= 0 && target.is_decided(parser, test_num, options.target_score)) {
+                skip_target_groups(test_num, parser);
+            }
+        } while (cache.is_open() && cache.replay(parser, test_num));
+    };
+    if (cache.is_open() && cache.replay(parser, test_num)) group_over();
+
+    // a target the config decides by itself leaves no test to run; a group
+    // left in the middle was already checked when it started
+    const Group *first_group = parser.find_group(test_num);
+    if (options.target_score >= 0 && (!first_group || first_group->get_first() == test_num)
+        && target.is_decided(parser, test_num, options.target_score)) {
+        skip_target_groups(test_num, parser);
+    }
+    // when resuming, with the cache or a target, the valuer tells the judge where to start
+    if (options.resume || cache.is_open() || options.target_score >= 0) reply = -test_num;
+    if (options.hint_fd >= 0) write_hints(parser, test_num, options);
+
+    ValuerVerdict verdict;
+    while (callback(user, test_num, reply, &verdict) == 0) {
+        Group *g = parser.find_group(test_num);
+        if (g && cache.is_open()) cache.add(g, test_num, verdict);
+        if (analyse_test_group(g, test_num, verdict.status) == CONTINUE_READING) {
+            reply = -1;
+        } else {
+            if (cache.is_open()) cache.store(parser, g);
+            group_over();
+            reply = -test_num;
+        }
+        if (checkpoint.is_open()) checkpoint.save(parser, test_num);
+        if (options.hint_fd >= 0) write_hints(parser, test_num, options);
+    }
+}
+
+// judges one run against an already parsed config
+static void run_parsed(ConfigParser &parser, const ValuerOptions &options,
+                       ValuerVerdictCallback callback, void *user, ValuerResult &result)
+{
+    parser.expand_groups();
+    parser.reset_state();
+    result = ValuerResult();
+    /*
+     * The comments are the only memory a run asks for, all at once. They
+     * are reserved in place rather than carved from an arena since they
+     * are handed back to the caller as std::string anyway.
+     */
+    result.comment.reserve(parser.get_comment_bound());
+    result.judge_comment.reserve(parser.get_judge_comment_bound());
+    scan_tests(parser, options, callback, user);
+    count_groups_score(parser, result, options);
+    if (options.report_path) write_report(options.report_path, parser, result);
+}
+
+int valuer_run(const char *config, size_t config_size,
+               const ValuerOptions &options,
+               ValuerVerdictCallback callback, void *user,
+               ValuerResult &result, std::string &error)
+{
+    try {
+        ConfigParser parser;
+        parser.parse(config, config_size, options.config_name);
+        run_parsed(parser, options, callback, user, result);
+    } catch (const std::exception &e) {
+        error = e.what();
+        return -1;
+    }
+    return 0;
+}
+
+#ifndef GVALUER_NO_MAIN
+
+static void
+die(const char *, ...)
+    __attribute__((noreturn, format(printf, 1, 2)));
+static void
+die(const char *format, ...)
+{
+    va_list args;
+    char buf[BUF_SIZE];
+
+    va_start(args, format);
+    vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+
+    fprintf(stderr, "fatal: %s\n", buf);
+    exit(RUN_CHECK_FAILED);
+}
+
+static void parse_args(int argc, char** argv, std::string& selfdir, std::string& self)
+{
+    if (argc == 3) {
+        size_t pos = self.find_last_of('/');
+        if (pos == std::string::npos) {
+            char buf[PATH_MAX];
+            if (!getcwd(buf, sizeof(buf))) die("getcwd() failed");
+            selfdir = buf;
+        } else if (pos == 0) {
+            die("won't work in the root directory");
+        } else if (self[0] == '/') {
+            selfdir = self.substr(0, pos);
+        } else {
+            char buf[PATH_MAX];
+            if (!getcwd(buf, sizeof(buf))) die("getcwd() failed");
+            selfdir = buf;
+            if (selfdir != "/") selfdir += '/';
+            selfdir += self.substr(0, pos);
+        }
+    } else {
+        selfdir = argv[3];
+    }
+}
+
+static bool environment_setup(ValuerOptions &options)
+{
+    bool interactive = false;
+
+    if (!getenv("EJUDGE")) die("EJUDGE environment variable must be std::set");
+    if (getenv("EJUDGE_USER_SCORE")) options.user_score = true;
+    if (getenv("EJUDGE_MARKED")) options.marked = true;
+    if (getenv("EJUDGE_INTERACTIVE")) interactive = true;
+    if (getenv("EJUDGE_REJUDGE")) options.rejudge = true;
+    options.report_path = getenv("EJUDGE_VALUER_REPORT");
+    options.checkpoint_path = getenv("EJUDGE_VALUER_CHECKPOINT");
+    if (getenv("EJUDGE_VALUER_RESUME")) options.resume = true;
+    options.verdict_cache_dir = getenv("EJUDGE_VALUER_VERDICT_CACHE");
+    options.submission_hash = getenv("EJUDGE_SUBMISSION_HASH");
+    options.test_hashes_path = getenv("EJUDGE_TEST_HASHES");
+    {
+        char *ts = getenv("EJUDGE_TARGET_SCORE");
+        if (ts) {
+            try {
+                options.target_score = std::stoi(ts);
+            } catch (...) {
+                die("invalid EJUDGE_TARGET_SCORE");
+            }
+        }
+    }
+    {
+        char *hs = getenv("EJUDGE_VALUER_HINT_FD");
+        if (hs) {
+            try {
+                options.hint_fd = std::stoi(hs);
+            } catch (...) {
+                die("invalid EJUDGE_VALUER_HINT_FD");
+            }
+            int flags = fcntl(options.hint_fd, F_GETFL);
+            if (flags < 0) die("invalid EJUDGE_VALUER_HINT_FD");
+            fcntl(options.hint_fd, F_SETFL, flags | O_NONBLOCK);
+        }
+        hs = getenv("EJUDGE_VALUER_HINT_COUNT");
+        if (hs) {
+            try {
+                options.hint_count = std::stoi(hs);
+            } catch (...) {
+            }
+            if (options.hint_count <= 0) options.hint_count = 1;
+        }
+    }
+    {
+        char *ls = getenv("EJUDGE_LOCALE");
+        if (ls) {
+            try {
+                options.locale_id = std::stoi(ls);
+            } catch (...) {
+            }
+            if (options.locale_id < 0) options.locale_id = 0;
+        }
+    }
+    return interactive;
+}
+
+static bool try_read_file(const std::string &path, std::string &text)
+{
+    FILE *f = fopen(path.c_str(), "r");
+    if (!f) return false;
+    text.clear();
+    char buf[BUF_SIZE];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        text.append(buf, n);
+    }
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+static std::string read_file(const std::string &path)
+{
+    std::string text;
+    if (!try_read_file(path, text)) die("cannot open config file '%s'", path.c_str());
+    return text;
+}
+
+// the judge sends whitespace-separated decimal verdicts on stdin
+static int text_protocol_verdict(void *, int, int reply, ValuerVerdict *verdict)
+{
+    if (reply != 0) {
+        printf("%d\n", reply);
+        fflush(stdout);
+    }
+    if (scanf("%d%d%d", &verdict->status, &verdict->score, &verdict->time) != 3) return 1;
+    return 0;
+}
+
+static void write_full(int fd, const void *buf, size_t size)
+{
+    const char *p = (const char *) buf;
+    while (size > 0) {
+        ssize_t r = write(fd, p, size);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            die("write failed: %s", strerror(errno));
+        }
+        p += r;
+        size -= r;
+    }
+}
+
+// returns false on EOF before the first byte
+static bool read_full(int fd, void *buf, size_t size)
+{
+    char *p = (char *) buf;
+    size_t done = 0;
+    while (done < size) {
+        ssize_t r = read(fd, p + done, size - done);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            die("read failed: %s", strerror(errno));
+        }
+        if (r == 0) {
+            if (done == 0) return false;
+            die("unexpected EOF");
+        }
+        done += r;
+    }
+    return true;
+}
+
+/*
+ * The binary protocol, asked for by sending BINARY_PROTOCOL_COUNT as the
+ * count of tests and acknowledged with BINARY_PROTOCOL_MAGIC, uses
+ * little-endian records on the same pipes: int32 status, score, time for
+ * a verdict and a single int32 for a reply. The judge need not wait for
+ * the acknowledgement before its first verdict.
+ */
+static int binary_protocol_verdict(void *, int, int reply, ValuerVerdict *verdict)
+{
+    unsigned char buf[12];
+    if (reply != 0) {
+        store_int32(buf, reply);
+        write_full(1, buf, 4);
+    }
+    if (!read_full(0, buf, sizeof(buf))) return 1;
+    verdict->status = load_int32(buf);
+    verdict->score = load_int32(buf + 4);
+    verdict->time = load_int32(buf + 8);
+    return 0;
+}
+
+/*
+ * Reads the count of tests, the first number from the judge, a byte at a
+ * time up to the whitespace after it: the binary records that may follow
+ * right away must not end up in the stdin buffer.
+ */
+static bool read_test_count(int &count)
+{
+    char buf[32];
+    int len = 0;
+    while (1) {
+        char c;
+        ssize_t r = read(0, &c, 1);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        if (isspace((unsigned char) c)) {
+            if (len > 0) break;
+            continue;
+        }
+        if (len + 1 >= int(sizeof(buf))) return false;
+        buf[len++] = c;
+    }
+    buf[len] = 0;
+    char *end;
+    errno = 0;
+    long value = strtol(buf, &end, 10);
+    if (len == 0 || *end || errno || value < INT_MIN || value > INT_MAX) return false;
+    count = value;
+    return true;
+}
+
+// reads the count of tests and answers for the protocol it asks for
+static ValuerVerdictCallback negotiate_protocol()
+{
+    int total_count = 0;
+    if (!read_test_count(total_count)) die("expected the count of tests");
+    if (total_count == BINARY_PROTOCOL_COUNT) {
+        write_full(1, BINARY_PROTOCOL_MAGIC, 4);
+        return binary_protocol_verdict;
+    }
+    if (total_count != -1) die("count value must be -1 or %d", BINARY_PROTOCOL_COUNT);
+    return text_protocol_verdict;
+}
+
+static void write_comment(const char *path, const std::string &text)
+{
+    FILE *f = fopen(path, "w");
+    if (!f) die("cannot open file '%s' for writing", path);
+    fwrite(text.data(), 1, text.size(), f);
+    fclose(f);
+}
+
+// round trips per second between a judge and a valuer over pipes
+static double bench_protocol(bool binary, int rounds)
+{
+    int to_valuer[2], from_valuer[2];
+    if (pipe(to_valuer) < 0 || pipe(from_valuer) < 0) die("pipe() failed");
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) die("fork() failed");
+    if (!pid) {
+        dup2(to_valuer[0], 0);
+        dup2(from_valuer[1], 1);
+        close(to_valuer[0]); close(to_valuer[1]);
+        close(from_valuer[0]); close(from_valuer[1]);
+
+        ValuerVerdictCallback callback = negotiate_protocol();
+        ValuerVerdict verdict;
+        int reply = 0;
+        while (callback(NULL, 0, reply, &verdict) == 0) reply = -1;
+        _exit(0);
+    }
+    close(to_valuer[0]);
+    close(from_valuer[1]);
+
+    FILE *jout = fdopen(to_valuer[1], "w");
+    FILE *jin = fdopen(from_valuer[0], "r");
+    if (!jout || !jin) die("fdopen() failed");
+
+    // the handshake as a judge does it, the first verdict goes without waiting for the answer
+    char count[16];
+    int count_len = snprintf(count, sizeof(count), "%d\n", binary ? BINARY_PROTOCOL_COUNT : -1);
+    write_full(to_valuer[1], count, count_len);
+
+    struct timespec start, finish;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < rounds; ++i) {
+        int reply = 0;
+        if (binary) {
+            unsigned char buf[12];
+            store_int32(buf, RUN_OK);
+            store_int32(buf + 4, 0);
+            store_int32(buf + 8, i);
+            write_full(to_valuer[1], buf, sizeof(buf));
+            if (i == 0) {
+                if (!read_full(from_valuer[0], buf, 4)) die("valuer has exited");
+                if (memcmp(buf, BINARY_PROTOCOL_MAGIC, 4) != 0) die("binary protocol not acknowledged");
+            }
+            if (!read_full(from_valuer[0], buf, 4)) die("valuer has exited");
+            reply = load_int32(buf);
+        } else {
+            fprintf(jout, "%d %d %d\n", RUN_OK, 0, i);
+            fflush(jout);
+            if (fscanf(jin, "%d", &reply) != 1) die("valuer has exited");
+        }
+        if (reply != -1) die("unexpected reply %d", reply);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &finish);
+
+    fclose(jout);
+    fclose(jin);
+    waitpid(pid, NULL, 0);
+
+    double seconds = (finish.tv_sec - start.tv_sec) + (finish.tv_nsec - start.tv_nsec) * 1e-9;
+    return rounds / seconds;
+}
+
+// gvaluer --bench-protocol [ROUNDS]
+static int bench_protocol_main(int argc, char *argv[])
+{
+    if (argc > 1) die("invalid number of arguments");
+    int rounds = 100000;
+    if (argc > 0) {
+        try {
+            rounds = std::stoi(argv[0]);
+        } catch (...) {
+            die("invalid round count '%s'", argv[0]);
+        }
+    }
+    if (rounds <= 0) die("invalid round count '%s'", argv[0]);
+
+    printf("text protocol: %.0f round trips/s\n", bench_protocol(false, rounds));
+    printf("binary protocol: %.0f round trips/s\n", bench_protocol(true, rounds));
+    return 0;
+}
+
+// runs fn(0), ..., fn(thread_count - 1) in parallel and waits for all
+template<typename F>
+static void run_in_threads(int thread_count, F fn)
+{
+    std::vector<std::thread> threads;
+    for (int i = 1; i < thread_count; ++i) {
+        threads.emplace_back(fn, i);
+    }
+    fn(0);
+    for (std::thread &t : threads) t.join();
+}
+
+static int parse_thread_count(const char *str)
+{
+    int count = 0;
+    if (str) {
+        try {
+            count = std::stoi(str);
+        } catch (...) {
+            die("invalid thread count '%s'", str);
+        }
+    }
+    if (count <= 0) count = std::thread::hardware_concurrency();
+    if (count <= 0) count = 1;
+    return count;
+}
+
+// uses the compiled cache when it is up to date
+static ConfigParser parse_config_file(const std::string &path)
+{
+    std::string config = read_file(path);
+    std::string cache;
+    if (try_read_file(path + CONFIG_CACHE_SUFFIX, cache)) {
+        // a broken cache is only a missed one, the config itself is parsed then
+        ConfigParser cached;
+        try {
+            if (cached.load_cache(cache.data(), cache.size(), fnv1a64(config.data(), config.size()), path))
+                return cached;
+        } catch (const ValuerError &) {
+        }
+    }
+    ConfigParser parser;
+    try {
+        parser.parse(config.data(), config.size(), path);
+    } catch (const ValuerError &e) {
+        die("%s", e.what());
+    }
+    return parser;
+}
+
+// directories that cannot be read go to errors, the search goes on
+static void find_configs(const std::string &dir, std::vector<std::string> &paths, std::vector<std::string> &errors)
+{
+    DIR *d = opendir(dir.c_str());
+    if (!d) {
+        errors.push_back(dir + ": cannot open directory: " + strerror(errno));
+        return;
+    }
+    struct dirent *e;
+    while ((e = readdir(d))) {
+        std::string name = e->d_name;
+        if (name == "." || name == "..") continue;
+        std::string path = dir + "/" + name;
+        struct stat st;
+        if (lstat(path.c_str(), &st) < 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            find_configs(path, paths, errors);
+        } else if (name == "valuer.cfg" && (S_ISREG(st.st_mode) || S_ISLNK(st.st_mode))) {
+            paths.push_back(path);
+        }
+    }
+    closedir(d);
+}
+
+struct ConfigCheck
+{
+    std::string error;
+    int groups = 0;
+    int generators = 0;
+    int generated_groups = 0;
+    int tests = 0;
+    bool cache_written = false;
+};
+
+static void check_config(const std::string &path, bool write_cache, ConfigCheck &check)
+{
+    std::string config;
+    if (!try_read_file(path, config)) {
+        check.error = "cannot read file";
+        return;
+    }
+    try {
+        ConfigParser parser;
+        parser.parse(config.data(), config.size(), path);
+        check.groups = parser.get_groups().size();
+        for (const Group &g : parser.get_groups()) check.tests = std::max(check.tests, g.get_last());
+        for (const GroupGenerator &gen : parser.get_generators()) {
+            ++check.generators;
+            check.generated_groups += gen.get_count();
+            check.tests = std::max(check.tests, gen.get_last());
+        }
+        if (!write_cache) return;
+
+        std::string cache = parser.save_cache();
+        std::string cache_path = path + CONFIG_CACHE_SUFFIX;
+        // a temporary file of its own, as another tree check may write the same cache
+        std::string tmp_path = cache_path + ".XXXXXX";
+        int fd = mkstemp(&tmp_path[0]);
+        if (fd < 0) {
+            check.error = "cannot write cache";
+            return;
+        }
+        fchmod(fd, 0644);
+        struct iovec iov = { &cache[0], cache.size() };
+        bool ok = true;
+        try {
+            write_iov(fd, &iov, 1);
+        } catch (const ValuerError &) {
+            ok = false;
+        }
+        if (close(fd) < 0) ok = false;
+        if (!ok || rename(tmp_path.c_str(), cache_path.c_str()) < 0) {
+            unlink(tmp_path.c_str());
+            check.error = "cannot write cache";
+            return;
+        }
+        check.cache_written = true;
+    } catch (const std::exception &e) {
+        check.error = e.what();
+    }
+}
+
+/*
+ * gvaluer --validate-tree [--write-cache] DIR [THREADS]
+ * Parses every valuer.cfg under DIR in parallel, optionally writing the
+ * compiled caches, and prints the errors and the totals.
+ */
+static int validate_tree_main(int argc, char *argv[])
+{
+    bool write_cache = false;
+    if (argc > 0 && !strcmp(argv[0], "--write-cache")) {
+        write_cache = true;
+        --argc;
+        ++argv;
+    }
+    if (argc < 1 || argc > 2) die("invalid number of arguments");
+    int thread_count = parse_thread_count(argc > 1 ? argv[1] : NULL);
+
+    struct timespec start, finish;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    std::vector<std::string> paths, dir_errors;
+    find_configs(argv[0], paths, dir_errors);
+    sort(paths.begin(), paths.end());
+    sort(dir_errors.begin(), dir_errors.end());
+
+    std::vector<ConfigCheck> checks(paths.size());
+    std::atomic<size_t> next(0);
+    run_in_threads(thread_count, [&](int) {
+        size_t i;
+        while ((i = next++) < paths.size()) {
+            check_config(paths[i], write_cache, checks[i]);
+        }
+    });
+    clock_gettime(CLOCK_MONOTONIC, &finish);
+
+    for (const std::string &e : dir_errors) printf("%s\n", e.c_str());
+    long long invalid = 0, groups = 0, generators = 0, generated_groups = 0, tests = 0, caches = 0;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        const ConfigCheck &c = checks[i];
+        if (!c.error.empty()) {
+            ++invalid;
+            // parse errors already start with the path
+            if (c.error.compare(0, paths[i].length(), paths[i]) == 0) {
+                printf("%s\n", c.error.c_str());
+            } else {
+                printf("%s: %s\n", paths[i].c_str(), c.error.c_str());
+            }
+        }
+        groups += c.groups;
+        generators += c.generators;
+        generated_groups += c.generated_groups;
+        tests += c.tests;
+        caches += c.cache_written;
+    }
+
+    printf("configs: %zu, valid: %lld, invalid: %lld\n", paths.size(), (long long) paths.size() - invalid, invalid);
+    printf("groups: %lld, generators: %lld (%lld groups), tests: %lld\n", groups, generators, generated_groups, tests);
+    if (write_cache) printf("caches written: %lld\n", caches);
+    if (!dir_errors.empty()) printf("directories not read: %zu\n", dir_errors.size());
+    printf("time: %.3f s\n", (finish.tv_sec - start.tv_sec) + (finish.tv_nsec - start.tv_nsec) * 1e-9);
+    return invalid > 0 || !dir_errors.empty();
+}
+
+struct TestModel
+{
+    double pass_probability = 1.0;
+    int time = 0;
+};
+
+/*
+ * A test model has a line per range of tests:
+ *     FIRST[-LAST] PASS_PROBABILITY TIME
+ * Lines starting with '#' are comments.
+ */
+static std::vector<TestModel> load_test_model(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) die("cannot open file '%s'", path);
+
+    std::vector<TestModel> model;
+    std::vector<bool> defined;
+    char line[BUF_SIZE];
+    int line_num = 0;
+    while (fgets(line, sizeof(line), f)) {
+        ++line_num;
+        char *p = line;
+        while (isspace(*p)) ++p;
+        if (!*p || *p == '#') continue;
+
+        int first = 0, last = 0, n = 0;
+        TestModel tm;
+        if (sscanf(p, "%d-%d %lf %d%n", &first, &last, &tm.pass_probability, &tm.time, &n) != 4) {
+            last = -1;
+            if (sscanf(p, "%d %lf %d%n", &first, &tm.pass_probability, &tm.time, &n) != 3) {
+                die("%s: %d: invalid test model line", path, line_num);
+            }
+            last = first;
+        }
+        if (first <= 0 || last < first) die("%s: %d: invalid test range", path, line_num);
+        if (tm.pass_probability < 0 || tm.pass_probability > 1) die("%s: %d: invalid probability", path, line_num);
+        if (tm.time < 0) die("%s: %d: invalid time", path, line_num);
+
+        if (int(model.size()) < last) {
+            model.resize(last);
+            defined.resize(last);
+        }
+        for (int i = first; i <= last; ++i) {
+            model[i - 1] = tm;
+            defined[i - 1] = true;
+        }
+    }
+    fclose(f);
+
+    for (int i = 0; i < int(defined.size()); ++i) {
+        if (!defined[i]) die("%s: no model for test %d", path, i + 1);
+    }
+    if (model.empty()) die("%s: empty test model", path);
+    return model;
+}
+
+/*
+ * Verdict traces have a line per run: STATUS[:TIME] for tests 1, 2, ...
+ * up to the last test the run had, or '-' for a test the run did not
+ * have. Lines starting with '#' are comments. The valuer doesn't write
+ * traces; they are exported from the judge's testing protocols of past
+ * runs, which list the tests in order and mark the skipped ones.
+ */
+#define TRACE_NOT_RUN (-1)
+
+struct VerdictTraces
+{
+    std::vector<ValuerVerdict> verdicts;    // all the runs one after another
+    std::vector<size_t> offsets = { 0 };    // run i is [offsets[i], offsets[i + 1])
+
+    int size() const { return int(offsets.size()) - 1; }
+    const ValuerVerdict *run(int i) const { return verdicts.data() + offsets[i]; }
+    int run_length(int i) const { return int(offsets[i + 1] - offsets[i]); }
+};
+
+static bool read_trace_number(const char *&p, const char *end, int &value)
+{
+    if (p == end || !isdigit((unsigned char) *p)) return false;
+    long long v = 0;
+    for (; p != end && isdigit((unsigned char) *p); ++p) {
+        v = v * 10 + (*p - '0');
+        if (v > INT_MAX) return false;
+    }
+    value = int(v);
+    return true;
+}
+
+// returns 1 for a run, 0 for a blank or comment line, -1 for an error
+static int parse_trace_line(const char *p, const char *end, std::vector<ValuerVerdict> &run)
+{
+    run.clear();
+    while (p != end && isspace((unsigned char) *p)) ++p;
+    if (p == end || *p == '#') return 0;
+
+    while (p != end) {
+        ValuerVerdict v;
+        if (*p == '-') {
+            v.status = TRACE_NOT_RUN;
+            ++p;
+        } else if (!read_trace_number(p, end, v.status)) {
+            return -1;
+        }
+        if (p != end && *p == ':' && v.status != TRACE_NOT_RUN) {
+            ++p;
+            if (!read_trace_number(p, end, v.time)) return -1;
+        }
+        if (p != end && !isspace((unsigned char) *p)) return -1;
+        while (p != end && isspace((unsigned char) *p)) ++p;
+        run.push_back(v);
+    }
+    return 1;
+}
+
+static VerdictTraces load_verdict_traces(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) die("cannot open file '%s'", path);
+
+    VerdictTraces traces;
+    std::vector<ValuerVerdict> run;
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t len;
+    int line_num = 0;
+    while ((len = getline(&line, &line_size, f)) >= 0) {
+        ++line_num;
+        int r = parse_trace_line(line, line + len, run);
+        if (r < 0) die("%s: %d: invalid verdict", path, line_num);
+        if (r == 0) continue;
+        traces.verdicts.insert(traces.verdicts.end(), run.begin(), run.end());
+        traces.offsets.push_back(traces.verdicts.size());
+    }
+    free(line);
+    fclose(f);
+    return traces;
+}
+
+// the judge of a simulated run: a test model or a recorded trace
+struct SimulatedJudge
+{
+    const std::vector<TestModel> *model = NULL;
+    std::mt19937_64 rng;
+    std::uniform_real_distribution<double> coin;
+
+    const ValuerVerdict *trace = NULL;
+    int trace_length = 0;
+    int test_count = 0;         // the last test of the config
+    bool truncated = false;     // the trace ended before the run did
+
+    long long tests = 0;
+    long long time = 0;
+};
+
+static int simulated_verdict(void *user, int test_num, int, ValuerVerdict *verdict)
+{
+    SimulatedJudge *judge = (SimulatedJudge *) user;
+    if (judge->model) {
+        if (test_num < 1 || test_num > int(judge->model->size())) return 1;
+        const TestModel &tm = (*judge->model)[test_num - 1];
+        verdict->status = judge->coin(judge->rng) < tm.pass_probability ? RUN_OK : RUN_WRONG_ANSWER_ERR;
+        verdict->score = 0;
+        verdict->time = tm.time;
+    } else {
+        // a test the recorded run did not have ends the simulated one
+        if (test_num < 1 || test_num > judge->trace_length
+            || judge->trace[test_num - 1].status == TRACE_NOT_RUN) {
+            if (test_num >= 1 && test_num <= judge->test_count) judge->truncated = true;
+            return 1;
+        }
+        *verdict = judge->trace[test_num - 1];
+    }
+    ++judge->tests;
+    judge->time += verdict->time;
+    return 0;
+}
+
+struct SimulationStats
+{
+    long long runs = 0;
+    long long truncated = 0;    // runs left out of the estimates
+    long long tests = 0;
+    long long time = 0;
+    std::vector<long long> group_tests;
+
+    void merge(const SimulationStats &other)
+    {
+        runs += other.runs;
+        truncated += other.truncated;
+        tests += other.tests;
+        time += other.time;
+        if (group_tests.size() < other.group_tests.size()) group_tests.resize(other.group_tests.size());
+        for (int i = 0; i < int(other.group_tests.size()); ++i) {
+            group_tests[i] += other.group_tests[i];
+        }
+    }
+};
+
+static void simulate_run(ConfigParser &parser, const ValuerOptions &options,
+                         SimulatedJudge &judge, SimulationStats &stats)
+{
+    ValuerResult result;
+    judge.tests = 0;
+    judge.time = 0;
+    judge.truncated = false;
+    run_parsed(parser, options, simulated_verdict, &judge, result);
+    ++stats.runs;
+    // the verdicts of a cut trace would count as those of a complete run
+    if (judge.truncated) {
+        ++stats.truncated;
+        return;
+    }
+
+    const std::vector<Group> &groups = parser.get_groups();
+    stats.group_tests.resize(groups.size());
+    for (int i = 0; i < int(groups.size()); ++i) {
+        stats.group_tests[i] += groups[i].get_tested_count();
+    }
+    stats.tests += judge.tests;
+    stats.time += judge.time;
+}
+
+/*
+ * gvaluer --simulate CONFIG MODEL [RUNS [THREADS]]
+ * gvaluer --simulate-traces CONFIG TRACES [THREADS]
+ * Estimates the number of tests and the judge time a submission costs
+ * with the given config, by Monte-Carlo over a test model or by replaying
+ * recorded verdict traces. Traces that end before the run does are
+ * counted apart and left out of the estimates.
+ */
+static int simulate_main(int argc, char *argv[], bool use_traces)
+{
+    if (argc < 2 || argc > (use_traces ? 3 : 4)) die("invalid number of arguments");
+
+    ConfigParser parser = parse_config_file(argv[0]);
+    parser.expand_groups();
+    ValuerOptions options;
+    if (getenv("EJUDGE_REJUDGE")) options.rejudge = true;
+
+    std::vector<TestModel> model;
+    VerdictTraces traces;
+    long long run_count = 0;
+    int thread_count;
+    if (use_traces) {
+        traces = load_verdict_traces(argv[1]);
+        run_count = traces.size();
+        thread_count = parse_thread_count(argc > 2 ? argv[2] : NULL);
+    } else {
+        model = load_test_model(argv[1]);
+        // a run must not end early for want of a model
+        const std::vector<Group> &groups = parser.get_groups();
+        if (!groups.empty() && groups.back().get_last() > int(model.size()))
+            die("%s: no model for test %d", argv[1], int(model.size()) + 1);
+        run_count = 100000;
+        if (argc > 2) {
+            try {
+                run_count = std::stoll(argv[2]);
+            } catch (...) {
+                die("invalid run count '%s'", argv[2]);
+            }
+        }
+        thread_count = parse_thread_count(argc > 3 ? argv[3] : NULL);
+    }
+    if (run_count <= 0) die("nothing to simulate");
+
+    std::vector<SimulationStats> thread_stats(thread_count);
+    std::vector<std::string> thread_errors(thread_count);
+    run_in_threads(thread_count, [&](int t) {
+        ConfigParser local_parser(parser);
+        SimulatedJudge judge;
+        judge.rng.seed(t + 1);
+        if (!use_traces) judge.model = &model;
+        if (!parser.get_groups().empty()) judge.test_count = parser.get_groups().back().get_last();
+        try {
+            for (long long i = t; i < run_count; i += thread_count) {
+                if (use_traces) {
+                    judge.trace = traces.run(i);
+                    judge.trace_length = traces.run_length(i);
+                }
+                simulate_run(local_parser, options, judge, thread_stats[t]);
+            }
+        } catch (const ValuerError &e) {
+            thread_errors[t] = e.what();
+        }
+    });
+
+    SimulationStats stats;
+    for (int t = 0; t < thread_count; ++t) {
+        if (!thread_errors[t].empty()) die("%s", thread_errors[t].c_str());
+        stats.merge(thread_stats[t]);
+    }
+
+    long long runs = stats.runs - stats.truncated > 0 ? stats.runs - stats.truncated : 1;
+    printf("runs: %lld\n", stats.runs);
+    printf("truncated runs: %lld\n", stats.truncated);
+    printf("expected tests per run: %.3f\n", double(stats.tests) / runs);
+    printf("expected judge time per run: %.3f\n", double(stats.time) / runs);
+    const std::vector<Group> &groups = parser.get_groups();
+    for (int i = 0; i < int(groups.size()); ++i) {
+        printf("group %s (%d-%d): expected tests %.3f\n",
+               groups[i].get_group_id().c_str(), groups[i].get_first(), groups[i].get_last(),
+               i < int(stats.group_tests.size()) ? double(stats.group_tests[i]) / runs : 0.0);
+    }
+    return 0;
+}
+
+// a file mapped into memory for reading
+class MappedFile
+{
+    void *addr = NULL;
+    size_t size = 0;
+
+public:
+    explicit MappedFile(const char *path)
+    {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) die("cannot open file '%s'", path);
+        struct stat st;
+        if (fstat(fd, &st) < 0) die("cannot stat file '%s'", path);
+        size = st.st_size;
+        if (size > 0) {
+            addr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr == MAP_FAILED) die("cannot map file '%s'", path);
+        }
+        close(fd);
+    }
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile()
+    {
+        if (addr) munmap(addr, size);
+    }
+
+    const char *data() const { return (const char *) addr; }
+    size_t get_size() const { return size; }
+};
+
+struct GroupCounters
+{
+    long long tested = 0;
+    long long passed = 0;
+    long long skips[SKIP_REASON_COUNT] = {};
+};
+
+struct AnalyticsStats
+{
+    long long runs = 0;
+    long long truncated = 0;    // runs left out of the group counts
+    long long bad_lines = 0;
+    std::vector<GroupCounters> groups;
+    std::vector<long long> test_executed;
+    std::vector<long long> test_passed;
+
+    void merge(const AnalyticsStats &other)
+    {
+        runs += other.runs;
+        truncated += other.truncated;
+        bad_lines += other.bad_lines;
+        for (int i = 0; i < int(groups.size()); ++i) {
+            groups[i].tested += other.groups[i].tested;
+            groups[i].passed += other.groups[i].passed;
+            for (int r = 0; r < SKIP_REASON_COUNT; ++r) groups[i].skips[r] += other.groups[i].skips[r];
+        }
+        for (int i = 0; i < int(test_executed.size()); ++i) {
+            test_executed[i] += other.test_executed[i];
+            test_passed[i] += other.test_passed[i];
+        }
+    }
+};
+
+struct AnalyticsJudge
+{
+    const std::vector<ValuerVerdict> *run = NULL;
+    AnalyticsStats *stats = NULL;
+    int test_count = 0;         // the last test of the config
+    bool truncated = false;     // the trace ended before the run did
+};
+
+static int analytics_verdict(void *user, int test_num, int, ValuerVerdict *verdict)
+{
+    AnalyticsJudge *judge = (AnalyticsJudge *) user;
+    if (test_num < 1 || test_num > int(judge->run->size())
+        || (*judge->run)[test_num - 1].status == TRACE_NOT_RUN) {
+        if (test_num >= 1 && test_num <= judge->test_count) judge->truncated = true;
+        return 1;
+    }
+    *verdict = (*judge->run)[test_num - 1];
+    if (test_num <= int(judge->stats->test_executed.size())) {
+        ++judge->stats->test_executed[test_num - 1];
+        if (verdict->status == RUN_OK) ++judge->stats->test_passed[test_num - 1];
+    }
+    return 0;
+}
+
+/*
+ * gvaluer --analytics CONFIG TRACES [THREADS]
+ * Replays recorded verdict traces (see load_verdict_traces) through the
+ * valuer and prints the pass rates of the groups and the tests and how
+ * often the groups were skipped, by reason. Traces that end before the
+ * run does are counted apart and left out of the group counts, their
+ * verdicts still count for the tests. Every thread takes a part of
+ * the mapped trace file and counts on its own; the counts are summed up
+ * at the end.
+ */
+static int analytics_main(int argc, char *argv[])
+{
+    if (argc < 2 || argc > 3) die("invalid number of arguments");
+
+    ConfigParser parser = parse_config_file(argv[0]);
+    parser.expand_groups();
+    ValuerOptions options;
+    if (getenv("EJUDGE_REJUDGE")) options.rejudge = true;
+    int thread_count = parse_thread_count(argc > 2 ? argv[2] : NULL);
+
+    MappedFile traces(argv[1]);
+    const char *data = traces.data();
+    size_t size = traces.get_size();
+    const std::vector<Group> &groups = parser.get_groups();
+    int test_count = groups.back().get_last();
+
+    std::vector<AnalyticsStats> thread_stats(thread_count);
+    std::vector<std::string> thread_errors(thread_count);
+    run_in_threads(thread_count, [&](int t) {
+        AnalyticsStats &stats = thread_stats[t];
+        stats.groups.resize(groups.size());
+        stats.test_executed.resize(test_count);
+        stats.test_passed.resize(test_count);
+
+        // a thread takes the lines that start in its part of the file
+        size_t begin = size * t / thread_count;
+        size_t end = size * (t + 1) / thread_count;
+        if (begin > 0) {
+            const char *nl = (const char *) memchr(data + begin - 1, '\n', size - begin + 1);
+            begin = nl ? nl - data + 1 : size;
+        }
+
+        ConfigParser local_parser(parser);
+        std::vector<ValuerVerdict> run;
+        AnalyticsJudge judge;
+        judge.run = &run;
+        judge.stats = &stats;
+        judge.test_count = test_count;
+        try {
+            while (begin < end) {
+                const char *line = data + begin;
+                const char *nl = (const char *) memchr(line, '\n', size - begin);
+                const char *line_end = nl ? nl : data + size;
+                begin = line_end - data + 1;
+
+                int r = parse_trace_line(line, line_end, run);
+                if (r < 0) ++stats.bad_lines;
+                if (r <= 0) continue;
+
+                local_parser.reset_state();
+                judge.truncated = false;
+                scan_tests(local_parser, options, analytics_verdict, &judge);
+                ++stats.runs;
+                if (judge.truncated) {
+                    ++stats.truncated;
+                    continue;
+                }
+                const std::vector<Group> &lg = local_parser.get_groups();
+                for (int i = 0; i < int(lg.size()); ++i) {
+                    GroupCounters &c = stats.groups[i];
+                    if (lg[i].get_tested_count() > 0) ++c.tested;
+                    if (lg[i].is_passed()) ++c.passed;
+                    ++c.skips[lg[i].get_skip_reason()];
+                }
+            }
+        } catch (const ValuerError &e) {
+            thread_errors[t] = e.what();
+        }
+    });
+
+    AnalyticsStats stats = thread_stats[0];
+    for (int t = 0; t < thread_count; ++t) {
+        if (!thread_errors[t].empty()) die("%s", thread_errors[t].c_str());
+        if (t > 0) stats.merge(thread_stats[t]);
+    }
+    if (stats.bad_lines > 0) fprintf(stderr, "warning: %lld invalid lines skipped\n", stats.bad_lines);
+
+    long long runs = stats.runs - stats.truncated > 0 ? stats.runs - stats.truncated : 1;
+    printf("runs: %lld\n", stats.runs);
+    printf("truncated runs: %lld\n", stats.truncated);
+    printf("%-16s %-11s %7s %7s %8s %9s %9s %9s %9s\n", "group", "tests", "tested%", "passed%",
+           "requires", "test_stop", "zero_set", "skip", "decided");
+    for (int i = 0; i < int(groups.size()); ++i) {
+        const GroupCounters &c = stats.groups[i];
+        char range[32];
+        snprintf(range, sizeof(range), "%d-%d", groups[i].get_first(), groups[i].get_last());
+        printf("%-16s %-11s %7.2f %7.2f %8lld %9lld %9lld %9lld %9lld\n",
+               groups[i].get_group_id().c_str(), range,
+               100.0 * c.tested / runs, 100.0 * c.passed / runs,
+               c.skips[SKIP_REQUIRES], c.skips[SKIP_TEST_STOP], c.skips[SKIP_ZERO_SET],
+               c.skips[SKIP_CONFIG], c.skips[SKIP_DECIDED]);
+    }
+    printf("%-6s %10s %10s %7s\n", "test", "executed", "passed", "pass%");
+    for (int i = 0; i < test_count; ++i) {
+        long long executed = stats.test_executed[i];
+        printf("%-6d %10lld %10lld %7.2f\n", i + 1, executed, stats.test_passed[i],
+               executed > 0 ? 100.0 * stats.test_passed[i] / executed : 0.0);
+    }
+    return 0;
+}
+
+// how a config change of a group affects the stored results of the runs
+enum
+{
+    CHANGE_NONE   = 0,
+    CHANGE_RESUM  = 1,      // the stored group result holds, only its score is counted again
+    CHANGE_REPLAY = 2,      // the tests of the group are to be replayed
+    CHANGE_RETEST = 3,      // the group has new tests
+};
+
+static const char *const change_names[] = { "unchanged", "resum", "replay", "retest" };
+
+static int classify_group_change(const Group *old_group, const Group &new_group, std::string &what)
+{
+    if (!old_group) {
+        what = "new group";
+        return CHANGE_RETEST;
+    }
+    if (old_group->get_first() != new_group.get_first() || old_group->get_last() != new_group.get_last()) {
+        what = "tests";
+        return CHANGE_RETEST;
+    }
+
+    int change = CHANGE_NONE;
+    auto note = [&](bool differs, int level, const char *name) {
+        if (!differs) return;
+        if (!what.empty()) what += ", ";
+        what += name;
+        change = std::max(change, level);
+    };
+    note(old_group->get_requires() != new_group.get_requires(), CHANGE_REPLAY, "requires");
+    note(old_group->get_skip() != new_group.get_skip(), CHANGE_REPLAY, "skip");
+    note(old_group->get_skip_if_not_rejudge() != new_group.get_skip_if_not_rejudge(), CHANGE_REPLAY, "skip_if_not_rejudge");
+    note(old_group->get_test_all() != new_group.get_test_all(), CHANGE_REPLAY, "test_all");
+    note(old_group->get_pass_if_count() != new_group.get_pass_if_count(), CHANGE_REPLAY, "pass_if_count");
+    note(old_group->get_stop_if_decided() != new_group.get_stop_if_decided(), CHANGE_REPLAY, "stop_if_decided");
+    note(old_group->get_test_score() != new_group.get_test_score(), CHANGE_REPLAY, "test_score");
+    note(old_group->get_zero_sets() != new_group.get_zero_sets(), CHANGE_REPLAY, "0_if");
+    note(old_group->get_offline() != new_group.get_offline(), CHANGE_REPLAY, "offline");
+    note(old_group->get_score() != new_group.get_score(), CHANGE_RESUM, "score");
+    note(old_group->get_user_status() != new_group.get_user_status(), CHANGE_RESUM, "user_status");
+    note(old_group->get_stat_to_judges() != new_group.get_stat_to_judges(), CHANGE_RESUM, "stat_to_judges");
+    note(old_group->get_stat_to_users() != new_group.get_stat_to_users(), CHANGE_RESUM, "stat_to_users");
+    note(old_group->get_sets_marked() != new_group.get_sets_marked(), CHANGE_RESUM, "sets_marked");
+    note(old_group->get_sets_marked_if_passed() != new_group.get_sets_marked_if_passed(), CHANGE_RESUM,
+         "sets_marked_if_passed");
+    return change;
+}
+
+// a group record of a structured report, see write_report
+struct StoredGroup
+{
+    std::string id;
+    int first = 0;
+    int last = 0;
+    int passed_count = 0;
+    int tested_count = 0;
+    int score = 0;
+    int skip_param = 0;
+    int status = 0;
+    int skip_reason = 0;
+    int flags = 0;
+};
+
+static bool load_stored_report(const std::string &path, std::vector<StoredGroup> &groups, std::string &error)
+{
+    std::string data;
+    if (!try_read_file(path, data)) {
+        error = "cannot read file";
+        return false;
+    }
+    if (data.size() < 28 || memcmp(data.data(), "GVR1", 4) != 0) {
+        error = "not a report";
+        return false;
+    }
+    try {
+        CacheReader in(data.data() + 4, data.size() - 4);
+        int count = in.get_int32();
+        for (int i = 0; i < 5; ++i) in.get_int32();
+        groups.assign(count < 0 ? 0 : count, StoredGroup());
+        for (StoredGroup &sg : groups) {
+            sg.first = in.get_int32();
+            sg.last = in.get_int32();
+            sg.passed_count = in.get_int32();
+            sg.tested_count = in.get_int32();
+            sg.score = in.get_int32();
+            sg.skip_param = in.get_int32();
+            sg.status = in.get_uint8();
+            sg.skip_reason = in.get_uint8();
+            sg.flags = in.get_uint8();
+            in.get_uint8();
+            sg.id = in.get_string();
+        }
+    } catch (const ValuerError &) {
+        error = "truncated report";
+        return false;
+    }
+    return true;
+}
+
+struct RescoreJudge
+{
+    const ConfigParser *parser = NULL;
+    const std::vector<ValuerVerdict> *trace = NULL;
+    bool missing = false;       // a test not in the trace is needed
+};
+
+static int rescore_verdict(void *user, int test_num, int, ValuerVerdict *verdict)
+{
+    RescoreJudge *judge = (RescoreJudge *) user;
+    if (!judge->parser->find_group(test_num)) return 1;
+    if (test_num > int(judge->trace->size()) || (*judge->trace)[test_num - 1].status == TRACE_NOT_RUN) {
+        judge->missing = true;
+        return 1;
+    }
+    *verdict = (*judge->trace)[test_num - 1];
+    return 0;
+}
+
+/*
+ * gvaluer --rescore OLD_CONFIG NEW_CONFIG RUNS [TRACES]
+ * Rescores stored runs after a config edit. RUNS lists the structured
+ * reports of the runs (EJUDGE_VALUER_REPORT) made with OLD_CONFIG, one
+ * path per line; the optional TRACES has the verdict trace of every run
+ * (see VerdictTraces) on the same line, or an empty line when there is
+ * none.
+ * The groups are compared one by one. Groups up to the first one that is
+ * to be replayed or retested keep their stored results, only the scores
+ * of the changed ones are counted again. The rest of the run is replayed
+ * from its trace; a run that needs a test it has no verdict for, past the
+ * end of the trace or marked as not run, is to be rejudged.
+ */
+static int rescore_main(int argc, char *argv[])
+{
+    if (argc < 3 || argc > 4) die("invalid number of arguments");
+
+    ConfigParser old_parser = parse_config_file(argv[0]);
+    old_parser.expand_groups();
+    ConfigParser new_parser = parse_config_file(argv[1]);
+    new_parser.expand_groups();
+    ValuerOptions options;
+    if (getenv("EJUDGE_REJUDGE")) options.rejudge = true;
+    if (getenv("EJUDGE_USER_SCORE")) options.user_score = true;
+    if (getenv("EJUDGE_MARKED")) options.marked = true;
+
+    const std::vector<Group> &old_groups = old_parser.get_groups();
+    std::vector<Group> &new_groups = new_parser.get_groups();
+    int group_count = new_groups.size();
+
+    std::unordered_map<std::string, int> new_index;
+    for (int i = 0; i < group_count; ++i) new_index[new_groups[i].get_group_id()] = i;
+    std::vector<int> old_to_new(old_groups.size(), -1);
+    for (int i = 0; i < int(old_groups.size()); ++i) {
+        auto it = new_index.find(old_groups[i].get_group_id());
+        if (it != new_index.end()) {
+            old_to_new[i] = it->second;
+        } else {
+            printf("group %s: removed\n", old_groups[i].get_group_id().c_str());
+        }
+    }
+
+    // groups before first_affected keep their stored results
+    std::vector<int> new_to_old(group_count, -1);
+    std::vector<int> changes(group_count);
+    int first_affected = group_count;
+    for (int i = 0; i < int(old_groups.size()); ++i) {
+        if (old_to_new[i] >= 0) new_to_old[old_to_new[i]] = i;
+    }
+    for (int i = 0; i < group_count; ++i) {
+        std::string what;
+        const Group *old_group = new_to_old[i] >= 0 ? &old_groups[new_to_old[i]] : NULL;
+        changes[i] = classify_group_change(old_group, new_groups[i], what);
+        if (changes[i] >= CHANGE_REPLAY && first_affected == group_count) first_affected = i;
+        if (changes[i] != CHANGE_NONE) {
+            printf("group %s: %s (%s)\n", new_groups[i].get_group_id().c_str(), change_names[changes[i]], what.c_str());
+        }
+    }
+
+    FILE *runs = fopen(argv[2], "r");
+    if (!runs) die("cannot open file '%s'", argv[2]);
+    FILE *traces = NULL;
+    if (argc > 3 && !(traces = fopen(argv[3], "r"))) die("cannot open file '%s'", argv[3]);
+
+    long long run_count = 0, resummed = 0, replayed = 0, rejudged = 0, failed = 0;
+    char *line = NULL, *trace_line = NULL;
+    size_t line_size = 0, trace_line_size = 0;
+    ssize_t len;
+    std::vector<StoredGroup> stored;
+    std::vector<ValuerVerdict> trace;
+    while ((len = getline(&line, &line_size, runs)) >= 0) {
+        bool has_trace = false;
+        if (traces) {
+            ssize_t tlen = getline(&trace_line, &trace_line_size, traces);
+            has_trace = tlen >= 0 && parse_trace_line(trace_line, trace_line + tlen, trace) > 0;
+        }
+        while (len > 0 && isspace((unsigned char) line[len - 1])) line[--len] = 0;
+        if (len == 0) continue;
+        ++run_count;
+
+        std::string error;
+        if (!load_stored_report(line, stored, error)) {
+            ++failed;
+            printf("%s: %s\n", line, error.c_str());
+            continue;
+        }
+        bool matches = stored.size() == old_groups.size();
+        for (int i = 0; matches && i < int(stored.size()); ++i) {
+            matches = stored[i].id == old_groups[i].get_group_id()
+                && stored[i].first == old_groups[i].get_first() && stored[i].last == old_groups[i].get_last();
+        }
+        if (!matches) {
+            ++failed;
+            printf("%s: report does not match the old config\n", line);
+            continue;
+        }
+
+        // the groups up to the last tested one before first_affected are kept
+        new_parser.reset_state();
+        int kept = -1;
+        for (int i = 0; i < first_affected; ++i) {
+            if (stored[new_to_old[i]].tested_count > 0) kept = i;
+        }
+        int restored = first_affected < group_count ? kept + 1 : group_count;
+        for (int i = 0; i < restored; ++i) {
+            const StoredGroup &sg = stored[new_to_old[i]];
+            int param = sg.skip_param;
+            if (sg.skip_reason == SKIP_REQUIRES) {
+                if (param < 0 || param >= int(old_to_new.size()) || old_to_new[param] < 0) die("%s: invalid report", line);
+                param = old_to_new[param];
+            }
+            int total_score = old_groups[new_to_old[i]].get_test_score() >= 0 ? sg.score : 0;
+            new_groups[i].restore_state(sg.passed_count, sg.tested_count, total_score, sg.skip_reason, param);
+        }
+
+        const char *method = "resum";
+        if (first_affected < group_count) {
+            if (!has_trace) {
+                ++rejudged;
+                printf("%s rejudge\n", line);
+                continue;
+            }
+            RescoreJudge judge;
+            judge.parser = &new_parser;
+            judge.trace = &trace;
+            int first_test = kept >= 0 ? next_group_test(new_parser, new_groups[kept].get_last() + 1, options) : 1;
+            try {
+                scan_tests(new_parser, options, rescore_verdict, &judge, first_test);
+            } catch (const ValuerError &e) {
+                ++failed;
+                printf("%s: %s\n", line, e.what());
+                continue;
+            }
+            if (judge.missing) {
+                ++rejudged;
+                printf("%s rejudge\n", line);
+                continue;
+            }
+            method = "replay";
+            ++replayed;
+        } else {
+            ++resummed;
+        }
+
+        ValuerResult result;
+        count_groups_score(new_parser, result, options);
+        printf("%s %s %d %d %d %d %d\n", line, method, result.score, result.marked,
+               result.user_status, result.user_score, result.user_tests_passed);
+    }
+    free(line);
+    free(trace_line);
+    fclose(runs);
+    if (traces) fclose(traces);
+
+    printf("runs: %lld, resummed: %lld, replayed: %lld, rejudge: %lld, failed: %lld\n",
+           run_count, resummed, replayed, rejudged, failed);
+    return failed > 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc >= 2 && !strcmp(argv[1], "--simulate")) return simulate_main(argc - 2, argv + 2, false);
+    if (argc >= 2 && !strcmp(argv[1], "--simulate-traces")) return simulate_main(argc - 2, argv + 2, true);
+    if (argc >= 2 && !strcmp(argv[1], "--bench-protocol")) return bench_protocol_main(argc - 2, argv + 2);
+    if (argc >= 2 && !strcmp(argv[1], "--validate-tree")) return validate_tree_main(argc - 2, argv + 2);
+    if (argc >= 2 && !strcmp(argv[1], "--analytics")) return analytics_main(argc - 2, argv + 2);
+    if (argc >= 2 && !strcmp(argv[1], "--rescore")) return rescore_main(argc - 2, argv + 2);
+    if (argc < 3 || argc > 4) die("invalid number of arguments");
+
+    std::string self(argv[0]);
+    std::string selfdir;
+    parse_args(argc, argv, selfdir, self);
+
+    ValuerOptions options;
+    bool interactive = environment_setup(options);
+
+    ConfigParser parser = parse_config_file(selfdir + "/valuer.cfg");
+
+    if (!interactive) die("non-interactive mode not yet supported");
+    ValuerVerdictCallback callback = negotiate_protocol();
+
+    ValuerResult result;
+    try {
+        run_parsed(parser, options, callback, NULL, result);
+    } catch (const std::exception &e) {
+        die("%s", e.what());
+    }
+
+    write_comment(argv[1], result.comment);
+    write_comment(argv[2], result.judge_comment);
+
+    printf("%d", result.score);
+    if (options.marked) {
+        printf(" %d", result.marked);
+    }
+    if (options.user_score) {
+        printf(" %d %d %d", result.user_status, result.user_score, result.user_tests_passed);
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+#endif /* GVALUER_NO_MAIN */
+
 /*
  * Local variables:
  *  c-basic-offset: 4
@@ -0,0 +1,91 @@
+/* Copyright (C) 2012-2017 Alexander Chernov <cher@ejudge.ru> */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef GVALUER_H
+#define GVALUER_H
+
+/*
+ * The embeddable valuer API. The library is gvaluer.cpp built with
+ * -DGVALUER_NO_MAIN; the command-line tool is a thin wrapper around it.
+ * valuer_run keeps no state between calls, so several runs may go on
+ * in parallel in different threads.
+ */
+
+#include <cstddef>
+#include <string>
+
+struct ValuerOptions
+{
+    bool marked = false;                // EJUDGE_MARKED
+    bool user_score = false;            // EJUDGE_USER_SCORE
+    bool rejudge = false;               // EJUDGE_REJUDGE
+    int locale_id = 0;                  // EJUDGE_LOCALE
+    const char *report_path = NULL;     // EJUDGE_VALUER_REPORT
+    const char *checkpoint_path = NULL; // EJUDGE_VALUER_CHECKPOINT
+    bool resume = false;                // EJUDGE_VALUER_RESUME
+    int hint_fd = -1;                   // EJUDGE_VALUER_HINT_FD, best non-blocking
+    int hint_count = 4;                 // EJUDGE_VALUER_HINT_COUNT
+    int target_score = -1;              // EJUDGE_TARGET_SCORE, testing stops once the score is
+                                        // known to be above or not above it; -1 for none
+    const char *verdict_cache_dir = NULL;   // EJUDGE_VALUER_VERDICT_CACHE, needs the two below
+    const char *submission_hash = NULL;     // EJUDGE_SUBMISSION_HASH
+    const char *test_hashes_path = NULL;    // EJUDGE_TEST_HASHES, a line per test with a hash of its data
+    const char *config_name = "valuer.cfg";
+};
+
+struct ValuerVerdict
+{
+    int status = 0;
+    int score = 0;
+    int time = 0;
+};
+
+/*
+ * Asks for the verdict of the test test_num. reply is what the valuer
+ * says to the judge before that: 0 for the first test, -1 to go on with
+ * the next test of the group, -test_num once a group is over. When
+ * resuming, using the verdict cache or a target score, the first reply
+ * is -test_num of the first test to run, past the last one when there is
+ * none.
+ * Returns 0 when the verdict is filled in, nonzero when there are no more.
+ */
+typedef int (*ValuerVerdictCallback)(void *user, int test_num, int reply, ValuerVerdict *verdict);
+
+struct ValuerResult
+{
+    int score = 0;
+    int marked = 0;
+    int user_status = 0;
+    int user_score = 0;
+    int user_tests_passed = 0;
+    std::string comment;                // for the user
+    std::string judge_comment;          // for the judges
+};
+
+/*
+ * Parses the config in config[0..config_size) and judges one run.
+ * Returns 0 on success and -1 on error, error then holds the message.
+ */
+int valuer_run(const char *config, size_t config_size,
+               const ValuerOptions &options,
+               ValuerVerdictCallback callback, void *user,
+               ValuerResult &result, std::string &error);
+
+#endif /* GVALUER_H */
+
+/*
+ * Local variables:
+ *  c-basic-offset: 4
+ * End:
+ */
@@ -0,0 +1,111 @@
+/* Copyright (C) 2012-2017 Alexander Chernov <cher@ejudge.ru> */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Checks that a run asks for no memory once the judge sends its first
+ * verdict: the global operator new counts the allocations, and a run
+ * must make none from the first callback to the end of valuer_run,
+ * comments of every kind in every locale included.
+ *
+ *   g++ -std=c++11 -DGVALUER_NO_MAIN -I. tests/alloc_test.cpp gvaluer.cpp -o alloc_test
+ *   ./alloc_test
+ */
+
+#include "gvaluer.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+
+static long allocations = 0;
+
+void *operator new(size_t size)
+{
+    ++allocations;
+    void *p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+// long ids, as the comments carry them
+static const char config[] =
+    "global { stat_to_judges; stat_to_users; }\n"
+    "group a_rather_long_group_identifier_of_the_first_group { tests 1-2; score 10; }\n"
+    "group stop { tests 3-5; score 10; }\n"
+    "group req { tests 6-6; score 10; requires stop; }\n"
+    "group zs { tests 7-9; test_score 5; 0_if 7; }\n"
+    "group dec { tests 10-14; score 10; pass_if_count 2; stop_if_decided; }\n"
+    "group skp { tests 15-15; score 10; skip; }\n"
+    "group tail { tests 16-17; score 10; }\n"
+    "group off { tests 18-18; score 10; offline; requires stop; }\n";
+
+// statuses of tests 1..18, '0' being OK
+static const char verdicts[] = "000500055111110000";
+
+struct Judge
+{
+    long first_allocations = -1;
+};
+
+static int verdict_callback(void *user, int test_num, int, ValuerVerdict *verdict)
+{
+    Judge *judge = (Judge *) user;
+    if (judge->first_allocations < 0) judge->first_allocations = allocations;
+    if (test_num < 1 || test_num > int(sizeof(verdicts) - 1)) return 1;
+    verdict->status = verdicts[test_num - 1] - '0';
+    verdict->score = 0;
+    verdict->time = 0;
+    return 0;
+}
+
+static bool check_run(int locale_id, int target_score)
+{
+    ValuerOptions options;
+    options.locale_id = locale_id;
+    options.user_score = true;
+    options.marked = true;
+    options.target_score = target_score;
+
+    Judge judge;
+    ValuerResult result;
+    std::string error;
+    if (valuer_run(config, sizeof(config) - 1, options, verdict_callback, &judge, result, error) < 0) {
+        printf("locale %d, target %d: %s\n", locale_id, target_score, error.c_str());
+        return false;
+    }
+    long count = allocations - judge.first_allocations;
+    printf("locale %d, target %d: %ld allocations, score %d\n", locale_id, target_score, count, result.score);
+    return count == 0 && !result.comment.empty();
+}
+
+int main()
+{
+    bool ok = true;
+    for (int locale_id = 0; locale_id <= 1; ++locale_id) {
+        ok = check_run(locale_id, -1) && ok;
+        ok = check_run(locale_id, 30) && ok;
+    }
+    return ok ? 0 : 1;
+}
+
+/*
+ * Local variables:
+ *  c-basic-offset: 4
+ * End:
+ */
@@ -0,0 +1,108 @@
+/* Copyright (C) 2012-2017 Alexander Chernov <cher@ejudge.ru> */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Checks the hint line written before a test is asked for against the
+ * tests the run goes on with, in the corners of next_group_test: a first
+ * group the config skips is still tested, and the requirements are not
+ * checked again once the config has skipped a group.
+ *
+ *   g++ -std=c++11 -DGVALUER_NO_MAIN -I. tests/hints_test.cpp gvaluer.cpp -o hints_test
+ *   ./hints_test
+ */
+
+#include "gvaluer.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+
+struct Judge
+{
+    const char *verdicts;
+    int hint_fd;
+    int test_num;
+    std::string hints;
+    std::string asked;
+};
+
+static int verdict_callback(void *user, int test_num, int, ValuerVerdict *verdict)
+{
+    Judge *judge = (Judge *) user;
+    char buf[1024];
+    int len = read(judge->hint_fd, buf, sizeof(buf) - 1);
+    if (len <= 0) return 1;
+    buf[len - 1] = 0;
+    if (test_num == judge->test_num) judge->hints = buf;
+    if (test_num < 1 || test_num > int(strlen(judge->verdicts))) return 1;
+    if (test_num >= judge->test_num) {
+        if (!judge->asked.empty()) judge->asked += ' ';
+        judge->asked += std::to_string(test_num);
+    }
+    verdict->status = judge->verdicts[test_num - 1] - '0';
+    verdict->score = 0;
+    verdict->time = 0;
+    return 0;
+}
+
+// the hints before test_num are expected to name the rest of the run
+static bool check_hints(const char *name, const char *config, const char *verdicts, int test_num)
+{
+    int fds[2];
+    if (pipe(fds) < 0) return false;
+    ValuerOptions options;
+    options.hint_fd = fds[1];
+    options.hint_count = 8;
+
+    Judge judge;
+    judge.verdicts = verdicts;
+    judge.hint_fd = fds[0];
+    judge.test_num = test_num;
+    ValuerResult result;
+    std::string error;
+    int r = valuer_run(config, strlen(config), options, verdict_callback, &judge, result, error);
+    close(fds[0]);
+    close(fds[1]);
+    if (r < 0) {
+        printf("%s: %s\n", name, error.c_str());
+        return false;
+    }
+    printf("%s: hints '%s', asked '%s'\n", name, judge.hints.c_str(), judge.asked.c_str());
+    return !judge.asked.empty() && judge.hints == judge.asked;
+}
+
+int main()
+{
+    bool ok = true;
+    ok = check_hints("skipped first group",
+        "group a { tests 1-2; skip_if_not_rejudge; }\n"
+        "group b { tests 3-4; }\n"
+        "group c { tests 5-6; requires a; }\n",
+        "000000", 1) && ok;
+    ok = check_hints("requires after a skip",
+        "group g1 { tests 1-2; }\n"
+        "group g2 { tests 3-4; }\n"
+        "group g3 { tests 5-8; requires g1; }\n"
+        "group g4 { tests 9-12; skip_if_not_rejudge; }\n"
+        "group g5 { tests 13-14; requires g1; }\n",
+        "50000000000000", 3) && ok;
+    return ok ? 0 : 1;
+}
+
+/*
+ * Local variables:
+ *  c-basic-offset: 4
+ * End:
+ */